@@ -0,0 +1,236 @@
+#include "stdafx.h"
+#include "Animation.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "utils/suStringTokens.h"
+#include "utils/suUtility.h"
+#include "utils/utWideExceptions.h"
+
+
+//-------------------------------------------------------------------------------------------
+Animation::Animation()
+    :m_mapTracks()
+    ,m_nFrames(0)
+    ,m_nBlock(1)
+    ,m_nCols(0)
+    ,m_nRows(0)
+    ,m_nCellsX(0)
+    ,m_nCellsY(0)
+    ,m_vCellPred()
+{}
+
+//-------------------------------------------------------------------------------------------
+Animation::~Animation()
+{}
+
+//-------------------------------------------------------------------------------------------
+void Animation::Reset()
+{
+    m_mapTracks.clear();
+    m_nFrames = 0;
+    m_nBlock = 1;
+    ClearPrediction();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Read the keyframes of all sources.
+    \param nFrames Number of frames to render.
+    \param nBlock Cell size of the prediction, 1 calculates all grid points of all frames.
+    */
+void Animation::Create(const au::IniFile &iniFile, int nFrames, int nBlock)
+{
+    static const wchar_t *szKeys[] = { _T("XPOS"), _T("YPOS"), _T("RAD"), _T("THETA"), _T("MULT"), _T("SIZE") };
+
+    Reset();
+
+    if (nFrames <= 0)
+        throw utils::wruntime_error(_T("Number of animation frames must be greater then zero."));
+
+    if (nBlock <= 0)
+        throw utils::wruntime_error(_T("Animation block size must be greater then zero."));
+
+    m_nFrames = nFrames;
+    m_nBlock = nBlock;
+
+    for (int i = 1;; ++i)
+    {
+        std::wstringstream ss;
+        ss << _T("SOURCE ") << i;
+        if (!iniFile.HasSection(ss.str()))
+            break;
+
+        for (std::size_t k = 0; k < sizeof(szKeys) / sizeof(szKeys[0]); ++k)
+        {
+            std::wstring sKey(std::wstring(szKeys[k]) + _T("_KEYS"));
+            if (iniFile.HasKey(ss.str(), sKey))
+                m_mapTracks[GetTrackName(ss.str(), szKeys[k])] = ParseTrack(iniFile.GetAsString(ss.str(), sKey));
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+bool Animation::IsCreated() const
+{
+    return m_nFrames > 0;
+}
+
+//-------------------------------------------------------------------------------------------
+int Animation::GetFrames() const
+{
+    return m_nFrames;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Value of a source parameter in a given frame.
+    \param fValue The configured value, returned if the parameter has no keyframes.
+    */
+double Animation::QueryValue(const std::wstring &sSection, const std::wstring &sKey, int nFrame, double fValue) const
+{
+    track_map_type::const_iterator it(m_mapTracks.find(GetTrackName(sSection, sKey)));
+    if (it == m_mapTracks.end())
+        return fValue;
+
+    const track_type &track(it->second);
+    if (nFrame <= track.front().frame)
+        return track.front().value;
+
+    for (std::size_t i = 1; i < track.size(); ++i)
+    {
+        if (nFrame > track[i].frame)
+            continue;
+
+        const SKey &k0(track[i - 1]), &k1(track[i]);
+        const double f((double)(nFrame - k0.frame) / (k1.frame - k0.frame));
+        return k0.value + f * (k1.value - k0.value);
+    }
+
+    return track.back().value;
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring Animation::GetDescription() const
+{
+    std::wstringstream ss;
+    ss << m_nFrames << _T(" frames, block ") << m_nBlock;
+    for (track_map_type::const_iterator it = m_mapTracks.begin(); it != m_mapTracks.end(); ++it)
+        ss << _T(", ") << it->first << _T(" (") << (int)it->second.size() << _T(" keys)");
+
+    return ss.str();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the prediction of the next frame.
+    \param prevIdx Source indices of the previous frame.
+    */
+void Animation::Predict(const int_field_type &prevIdx, int nCols, int nRows)
+{
+    ClearPrediction();
+    if (m_nBlock <= 1 || nCols < 2 || nRows < 2)
+        return;
+
+    m_nCols = nCols;
+    m_nRows = nRows;
+    m_nCellsX = (nCols - 2) / m_nBlock + 1;
+    m_nCellsY = (nRows - 2) / m_nBlock + 1;
+    m_vCellPred.assign(m_nCellsX * m_nCellsY, -1);
+
+    for (int cy = 0; cy < m_nCellsY; ++cy)
+    {
+        for (int cx = 0; cx < m_nCellsX; ++cx)
+        {
+            int x0(0), y0(0), x1(0), y1(0);
+            QueryCell(cx * m_nBlock, cy * m_nBlock, x0, y0, x1, y1);
+
+            // The cell including a margin of one grid point must go to a single source
+            const int nIdx(prevIdx[y0][x0]);
+            bool bRobust(nIdx >= 0);
+            for (int y = std::max(y0 - 1, 0); y <= std::min(y1 + 1, nRows - 1) && bRobust; ++y)
+            {
+                for (int x = std::max(x0 - 1, 0); x <= std::min(x1 + 1, nCols - 1) && bRobust; ++x)
+                    bRobust = (prevIdx[y][x] == nIdx);
+            }
+
+            if (bRobust)
+                m_vCellPred[cy * m_nCellsX + cx] = nIdx;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+void Animation::ClearPrediction()
+{
+    m_vCellPred.clear();
+    m_nCellsX = 0;
+    m_nCellsY = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+bool Animation::HasPrediction() const
+{
+    return !m_vCellPred.empty();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Predicted source index of a grid point.
+    \return The predicted index or -1 if the grid point must be calculated.
+
+    The corners of the cells are always calculated, they verify the prediction.
+    */
+int Animation::GetPrediction(int x, int y) const
+{
+    if (m_vCellPred.empty() || IsSample(x, y))
+        return -1;
+
+    const int cx(std::min(x / m_nBlock, m_nCellsX - 1)),
+              cy(std::min(y / m_nBlock, m_nCellsY - 1));
+    return m_vCellPred[cy * m_nCellsX + cx];
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Corners of the cell containing a grid point. */
+void Animation::QueryCell(int x, int y, int &x0, int &y0, int &x1, int &y1) const
+{
+    x0 = std::min(x / m_nBlock, m_nCellsX - 1) * m_nBlock;
+    y0 = std::min(y / m_nBlock, m_nCellsY - 1) * m_nBlock;
+    x1 = std::min(x0 + m_nBlock, m_nCols - 1);
+    y1 = std::min(y0 + m_nBlock, m_nRows - 1);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns true for the corners of the cells, the last row and column are corners too. */
+bool Animation::IsSample(int x, int y) const
+{
+    return (x % m_nBlock == 0 || x == m_nCols - 1) && (y % m_nBlock == 0 || y == m_nRows - 1);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Parse a list of keyframes, e.g. "0:90, 59:210". */
+Animation::track_type Animation::ParseTrack(const std::wstring &sKeys)
+{
+    track_type track;
+    su::StringTokens<std::wstring> tok(sKeys, _T(","));
+    for (unsigned i = 0; i < tok.Count(); ++i)
+    {
+        SKey key;
+        if (swscanf(su::trim(tok[i]).c_str(), _T("%d:%lf"), &key.frame, &key.value) != 2)
+            throw utils::wruntime_error(_T("Invalid keyframe format (a comma separated list of frame:value pairs is expected)."));
+
+        if (track.size() && key.frame <= track.back().frame)
+            throw utils::wruntime_error(_T("Keyframes must be given in ascending frame order."));
+
+        track.push_back(key);
+    }
+
+    if (track.empty())
+        throw utils::wruntime_error(_T("No keyframes given."));
+
+    return track;
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring Animation::GetTrackName(const std::wstring &sSection, const std::wstring &sKey)
+{
+    return su::to_upper(sSection) + _T("/") + sKey;
+}
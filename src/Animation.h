@@ -0,0 +1,72 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include "utils/auIniFile.h"
+#include "utils/muBlockMatrix.h"
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Keyframed source parameters and the prediction of a frame from its predecessor.
+
+  The parameters XPOS, YPOS, RAD, THETA, MULT and SIZE of a source can be keyframed with
+  the key [NAME]_KEYS in the source section, e.g. THETA_KEYS=0:90, 59:210. Keys are pairs
+  of a frame index and a value, values in between are interpolated linearly and the first
+  and last value are held outside of the keyed range.
+
+  Frames after the first one are predicted from the previous frame. The grid is divided
+  into cells of BLOCK x BLOCK grid points. A cell whose grid points, including a margin of
+  one grid point, all went to the same source in the previous frame is robust: only its
+  corners are calculated and the grid points in between are checked against them. The
+  trace length of a confirmed grid point is interpolated from the corners, it is an
+  approximation. With a block size of 1 every grid point of every frame is calculated.
+  */
+class Animation
+{
+public:
+    typedef mu::BlockMatrix<int> int_field_type;
+
+    Animation();
+    ~Animation();
+
+    void Reset();
+    void Create(const au::IniFile &iniFile, int nFrames, int nBlock);
+    bool IsCreated() const;
+    int GetFrames() const;
+    double QueryValue(const std::wstring &sSection, const std::wstring &sKey, int nFrame, double fValue) const;
+    std::wstring GetDescription() const;
+
+    void Predict(const int_field_type &prevIdx, int nCols, int nRows);
+    void ClearPrediction();
+    bool HasPrediction() const;
+    int GetPrediction(int x, int y) const;
+    void QueryCell(int x, int y, int &x0, int &y0, int &x1, int &y1) const;
+
+private:
+    struct SKey
+    {
+        int frame;      ///< Frame index of the key
+        double value;   ///< Parameter value at this frame
+    };
+
+    typedef std::vector<SKey> track_type;
+    typedef std::map<std::wstring, track_type> track_map_type;
+
+    track_map_type m_mapTracks;     ///< Keyframes per "section/key"
+    int m_nFrames;                  ///< Number of frames, 0 if there is no animation
+    int m_nBlock;                   ///< Cell size of the prediction in grid points
+    int m_nCols;                    ///< Grid columns
+    int m_nRows;                    ///< Grid rows
+    int m_nCellsX;                  ///< Number of cells per row
+    int m_nCellsY;                  ///< Number of cells per column
+    std::vector<int> m_vCellPred;   ///< Predicted source index per cell, -1 if not robust
+
+    static track_type ParseTrack(const std::wstring &sKeys);
+    static std::wstring GetTrackName(const std::wstring &sSection, const std::wstring &sKey);
+    bool IsSample(int x, int y) const;
+};
+
+#endif // include guard
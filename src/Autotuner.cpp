@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "Autotuner.h"
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "utils/utWideExceptions.h"
+#include "SimPend.h"
+
+
+//-------------------------------------------------------------------------------------------
+Autotuner::Autotuner()
+    :m_sFile()
+    ,m_sHost()
+    ,m_nClass(0)
+{}
+
+//-------------------------------------------------------------------------------------------
+Autotuner::~Autotuner()
+{}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the cache.
+    \param sCacheFile Cache file, shared by all hosts and configuration classes.
+    \param nClass Hash of the configuration class.
+    */
+void Autotuner::Create(const std::wstring &sCacheFile, unsigned long long nClass)
+{
+    m_sFile = sCacheFile;
+    m_sHost = GetHostKey();
+    m_nClass = nClass;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Find the settings of this host and configuration class in the cache.
+    \return false if there is no valid entry.
+    */
+bool Autotuner::Lookup(SSettings &settings) const
+{
+    std::wifstream ifs(m_sFile.c_str());
+    if (!ifs)
+        return false;
+
+    std::wstring sLine;
+    while (std::getline(ifs, sLine))
+    {
+        if (!sLine.length() || sLine[0] == _T('#'))
+            continue;
+
+        std::wstringstream ss(sLine);
+        std::wstring sHost, sLevel;
+        unsigned long long nClass(0);
+        SSettings entry = SSettings();
+        if (!std::getline(ss, sHost, _T('\t')) || !(ss >> std::hex >> nClass >> std::dec >> entry.nThreads >> sLevel >> entry.fRate))
+            continue;
+
+        if (sHost != m_sHost || nClass != m_nClass || entry.nThreads <= 0)
+            continue;
+
+        try
+        {
+            entry.eLevel = CpuDispatch::FromName(sLevel);
+        }
+        catch (...)
+        {
+            continue;
+        }
+
+        if (entry.eLevel > CpuDispatch::Detect())
+            continue;
+
+        settings = entry;
+        return true;
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add the settings to the cache, replacing an older entry of this host and class. */
+void Autotuner::Store(const SSettings &settings) const
+{
+    std::vector<std::wstring> vLines;
+    {
+        std::wifstream ifs(m_sFile.c_str());
+        std::wstring sLine;
+        while (ifs && std::getline(ifs, sLine))
+        {
+            if (!sLine.length() || sLine[0] == _T('#'))
+                continue;
+
+            std::wstringstream ss(sLine);
+            std::wstring sHost;
+            unsigned long long nClass(0);
+            if (std::getline(ss, sHost, _T('\t')) && (ss >> std::hex >> nClass) && sHost == m_sHost && nClass == m_nClass)
+                continue;
+
+            vLines.push_back(sLine);
+        }
+    }
+
+    std::wofstream ofs(m_sFile.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs)
+        throw utils::wruntime_error(_T("Can't write the autotune cache."));
+
+    ofs << _T("# host\tclass\tthreads\tcpu_dispatch\tpixels_per_s\n");
+    for (std::size_t i = 0; i < vLines.size(); ++i)
+        ofs << vLines[i] << _T("\n");
+
+    ofs << m_sHost << _T("\t") << std::hex << m_nClass << std::dec << _T("\t")
+        << settings.nThreads << _T("\t") << CpuDispatch::GetName(settings.eLevel) << _T("\t")
+        << (long long)settings.fRate << _T("\n");
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Find the fastest settings.
+    \param sim The simulation, its instruction set is restored afterwards.
+    \param nSamples Number of grid points integrated per candidate.
+    \param vThreads Candidate thread counts in ascending order.
+    \param vLevel Candidate instruction sets.
+
+  The instruction set is chosen with the largest thread count, so the clock reduction of
+  wide vector units under full load is taken into account. Then the thread count is chosen
+  with that instruction set. The smallest thread count within 2% of the best throughput is
+  taken, hyperthreads rarely help the floating point bound integration.
+  */
+Autotuner::SSettings Autotuner::Calibrate(SimImpl &sim, int nSamples, const std::vector<int> &vThreads, const std::vector<CpuDispatch::ELevel> &vLevel) const
+{
+    if (nSamples <= 0)
+        throw utils::wruntime_error(_T("Number of autotune samples must be greater then zero."));
+
+    if (vThreads.empty() || vLevel.empty())
+        throw utils::wruntime_error(_T("No autotune candidates."));
+
+    int nCols(0), nRows(0);
+    sim.QuerySimGrid(nCols, nRows);
+
+    // Same sample for every candidate
+    std::mt19937 rng(1);
+    std::vector<mu::vec2d_type> vPos(nSamples);
+    for (int i = 0; i < nSamples; ++i)
+    {
+        int x((int)(rng() % (unsigned)nCols)),
+            y((int)(rng() % (unsigned)nRows));
+        sim.GridCoordToModel(x, y, vPos[i][0], vPos[i][1]);
+    }
+
+    const CpuDispatch::ELevel eOrigLevel(sim.GetCpuLevel());
+    const int nMaxThreads(vThreads.back());
+
+    // The first run only warms up the caches
+    Measure(sim, vPos, nMaxThreads);
+
+    SSettings best = SSettings();
+    best.nThreads = nMaxThreads;
+    best.eLevel = vLevel[0];
+    for (std::size_t i = 0; i < vLevel.size(); ++i)
+    {
+        sim.SetCpuLevel(vLevel[i]);
+        const double fRate(nSamples / Measure(sim, vPos, nMaxThreads));
+        TRACE(_T("Autotune: %d threads, %s: %.0f px/s\n"), nMaxThreads, CpuDispatch::GetName(vLevel[i]), fRate);
+
+        if (fRate > best.fRate)
+        {
+            best.eLevel = vLevel[i];
+            best.fRate = fRate;
+        }
+    }
+
+    sim.SetCpuLevel(best.eLevel);
+    std::vector<double> vRate(vThreads.size(), best.fRate);
+    for (std::size_t i = 0; i + 1 < vThreads.size(); ++i)
+    {
+        vRate[i] = nSamples / Measure(sim, vPos, vThreads[i]);
+        TRACE(_T("Autotune: %d threads, %s: %.0f px/s\n"), vThreads[i], CpuDispatch::GetName(best.eLevel), vRate[i]);
+        if (vRate[i] > best.fRate)
+            best.fRate = vRate[i];
+    }
+
+    for (std::size_t i = 0; i < vThreads.size(); ++i)
+    {
+        if (vRate[i] >= 0.98 * best.fRate)
+        {
+            best.nThreads = vThreads[i];
+            best.fRate = vRate[i];
+            break;
+        }
+    }
+
+    sim.SetCpuLevel(eOrigLevel);
+    return best;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate the sample with a number of threads.
+    \return Wall clock time in seconds.
+    */
+double Autotuner::Measure(const SimImpl &sim, const std::vector<mu::vec2d_type> &vPos, int nThreads)
+{
+    SRun run;
+    run.pSim = &sim;
+    run.pPos = &vPos;
+    run.nNext = 0;
+
+    LARGE_INTEGER nFreq, nStart, nStop;
+    QueryPerformanceFrequency(&nFreq);
+    QueryPerformanceCounter(&nStart);
+
+    // Started suspended, a thread finishing before m_bAutoDelete is cleared would delete itself
+    std::vector<CWinThread*> vThreads;
+    for (int i = 0; i < nThreads; ++i)
+    {
+        CWinThread *pNewThread(AfxBeginThread(CalibrateMain,
+            reinterpret_cast<LPVOID>(&run),
+            THREAD_PRIORITY_NORMAL,
+            0,  // default stack size
+            CREATE_SUSPENDED,
+            NULL));
+        if (!pNewThread)
+            continue;
+
+        pNewThread->m_bAutoDelete = FALSE;
+        pNewThread->ResumeThread();
+        vThreads.push_back(pNewThread);
+    }
+
+    if (vThreads.empty())
+        throw utils::wruntime_error(_T("Can't create calibration threads."));
+
+    // WaitForMultipleObjects is limited to 64 handles
+    for (std::size_t i = 0; i < vThreads.size(); ++i)
+    {
+        WaitForSingleObject(vThreads[i]->m_hThread, INFINITE);
+        delete vThreads[i];
+    }
+
+    QueryPerformanceCounter(&nStop);
+    return (double)(nStop.QuadPart - nStart.QuadPart) / (double)nFreq.QuadPart;
+}
+
+//-------------------------------------------------------------------------------------------
+UINT Autotuner::CalibrateMain(LPVOID lpParam)
+{
+    const long nChunk = 4;
+
+    SRun &run(*static_cast<SRun*>(lpParam));
+    const long nSize((long)run.pPos->size());
+    for (;;)
+    {
+        const long i0(InterlockedExchangeAdd(&run.nNext, nChunk));
+        if (i0 >= nSize)
+            break;
+
+        for (long i = i0; i < i0 + nChunk && i < nSize; ++i)
+        {
+            int nSteps(0);
+            run.pSim->CalcSteps((*run.pPos)[i], nSteps);
+        }
+    }
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Host name, number of logical processors and the detected instruction set. */
+std::wstring Autotuner::GetHostKey()
+{
+    wchar_t szName[MAX_COMPUTERNAME_LENGTH + 1] = { 0 };
+    DWORD nLen(MAX_COMPUTERNAME_LENGTH + 1);
+    std::wstring sName((GetComputerName(szName, &nLen) && nLen) ? szName : _T("unknown"));
+
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+
+    return sName + _T("/") + std::to_wstring(sysinfo.dwNumberOfProcessors) + _T("/") + CpuDispatch::GetName(CpuDispatch::Detect());
+}
@@ -0,0 +1,60 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <string>
+#include <vector>
+
+#include "utils/muVector.h"
+#include "CpuDispatch.h"
+
+//---------------------------------------------------------------------------------------
+// Forward declarations
+class SimImpl;
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calibration of the thread count and the instruction set of the source kernel.
+
+  A seeded sample of grid points is integrated with each candidate setting, the one with
+  the highest throughput wins. The result is cached per host and configuration class,
+  configurations with the same integration settings and source layout share it.
+  */
+class Autotuner
+{
+public:
+    struct SSettings
+    {
+        int nThreads;               ///< Number of worker threads
+        CpuDispatch::ELevel eLevel; ///< Instruction set of the source kernel
+        double fRate;               ///< Grid points per second in the calibration
+    };
+
+    Autotuner();
+    ~Autotuner();
+
+    void Create(const std::wstring &sCacheFile, unsigned long long nClass);
+    bool Lookup(SSettings &settings) const;
+    void Store(const SSettings &settings) const;
+    SSettings Calibrate(SimImpl &sim, int nSamples, const std::vector<int> &vThreads, const std::vector<CpuDispatch::ELevel> &vLevel) const;
+
+private:
+    /** \brief Work shared by the calibration threads. */
+    struct SRun
+    {
+        const SimImpl *pSim;
+        const std::vector<mu::vec2d_type> *pPos;
+        volatile long nNext;        ///< Index of the next grid point to integrate
+    };
+
+    std::wstring m_sFile;           ///< The cache file
+    std::wstring m_sHost;           ///< Host name, processor count and detected instruction set
+    unsigned long long m_nClass;    ///< Hash of the configuration class
+
+    static double Measure(const SimImpl &sim, const std::vector<mu::vec2d_type> &vPos, int nThreads);
+    static UINT CalibrateMain(LPVOID lpParam);
+    static std::wstring GetHostKey();
+
+    Autotuner(const Autotuner &ref);
+    Autotuner& operator=(const Autotuner &ref);
+};
+
+#endif // include guard
@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "CpuDispatch.h"
+
+#include <intrin.h>
+
+#include "utils/utWideExceptions.h"
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Determine the highest instruction set level supported by cpu and operating system.
+
+  Besides the cpuid feature bits the operating system must save the extended register
+  state on context switches, this is checked with xgetbv.
+  */
+CpuDispatch::ELevel CpuDispatch::Detect()
+{
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    const int nMaxLeaf(info[0]);
+    if (nMaxLeaf < 7)
+        return lvGENERIC;
+
+    // Leaf 1: OSXSAVE (ecx bit 27), AVX (ecx bit 28), FMA (ecx bit 12)
+    __cpuid(info, 1);
+    const bool bOsxSave((info[2] & (1 << 27)) != 0);
+    const bool bAvx((info[2] & (1 << 28)) != 0);
+    const bool bFma((info[2] & (1 << 12)) != 0);
+    if (!bOsxSave || !bAvx)
+        return lvGENERIC;
+
+    // The OS must save the xmm and ymm registers
+    const unsigned long long xcr0(_xgetbv(0));
+    if ((xcr0 & 0x6) != 0x6)
+        return lvGENERIC;
+
+    // Leaf 7: AVX2 (ebx bit 5), AVX512 F (16), DQ (17), CD (28), BW (30), VL (31)
+    __cpuidex(info, 7, 0);
+    const unsigned ebx(static_cast<unsigned>(info[1]));
+    if (!bFma || !(ebx & (1u << 5)))
+        return lvGENERIC;
+
+    const unsigned avx512((1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31));
+    if ((ebx & avx512) != avx512)
+        return lvAVX2;
+
+    // The OS must also save the opmask and zmm registers
+    if ((xcr0 & 0xe6) != 0xe6)
+        return lvAVX2;
+
+    return lvAVX512;
+}
+
+//-------------------------------------------------------------------------------------------
+const wchar_t* CpuDispatch::GetName(ELevel eLevel)
+{
+    switch (eLevel)
+    {
+    case lvAVX2:   return _T("AVX2");
+    case lvAVX512: return _T("AVX512");
+    default:       return _T("GENERIC");
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Convert an upper case level name as used in the configuration file. */
+CpuDispatch::ELevel CpuDispatch::FromName(const std::wstring &sName)
+{
+    if (sName == _T("GENERIC"))
+        return lvGENERIC;
+    else if (sName == _T("AVX2"))
+        return lvAVX2;
+    else if (sName == _T("AVX512"))
+        return lvAVX512;
+    else
+        throw utils::wruntime_error(_T("Invalid cpu dispatch level (valid values are \"AUTO\", \"GENERIC\", \"AVX2\" or \"AVX512\")."));
+}
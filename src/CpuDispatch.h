@@ -0,0 +1,29 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <string>
+
+//-------------------------------------------------------------------------------------------
+/** \brief Detection of the instruction sets supported by the host cpu.
+
+  Hot code paths are compiled once per instruction set. The level is determined once at
+  startup and used to select the variant. A variant must never be called on a cpu that
+  does not support its instruction set, the level can therefore only be lowered by the
+  configuration.
+  */
+class CpuDispatch
+{
+public:
+    enum ELevel
+    {
+        lvGENERIC = 0,      ///< No extensions beyond the compiler default
+        lvAVX2,             ///< AVX2 and FMA3
+        lvAVX512            ///< AVX-512 F, CD, BW, DQ and VL
+    };
+
+    static ELevel Detect();
+    static const wchar_t* GetName(ELevel eLevel);
+    static ELevel FromName(const std::wstring &sName);
+};
+
+#endif // include guard
@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "CpuTopology.h"
+
+#include <utility>
+
+
+namespace
+{
+    //---------------------------------------------------------------------------------------
+    /** \brief Query the processor relationships of one kind into a buffer. */
+    bool QueryProcessorInfo(LOGICAL_PROCESSOR_RELATIONSHIP eRel, std::vector<char> &vBuf)
+    {
+        DWORD nLen(0);
+        if (GetLogicalProcessorInformationEx(eRel, nullptr, &nLen) || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+            return false;
+
+        vBuf.resize(nLen);
+        return GetLogicalProcessorInformationEx(eRel, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&vBuf[0]), &nLen) != FALSE;
+    }
+
+    //---------------------------------------------------------------------------------------
+    /** \brief Index of the n-th set bit of a mask or -1 if fewer bits are set. */
+    int GetSetBit(KAFFINITY nMask, int n)
+    {
+        for (int i = 0; i < (int)sizeof(KAFFINITY) * 8; ++i)
+        {
+            if ((nMask & ((KAFFINITY)1 << i)) && n-- == 0)
+                return i;
+        }
+
+        return -1;
+    }
+}
+
+
+//-------------------------------------------------------------------------------------------
+CpuTopology::CpuTopology()
+    :m_vNode()
+    ,m_nProc(0)
+    ,m_nCores(0)
+{}
+
+//-------------------------------------------------------------------------------------------
+CpuTopology::~CpuTopology()
+{}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Find the NUMA nodes, their processor cores and the logical processors of the cores.
+
+  If the relations can't be queried all processors of the first group form a single node
+  and every logical processor counts as a core.
+  */
+void CpuTopology::Discover()
+{
+    m_vNode.clear();
+    m_nProc = 0;
+    m_nCores = 0;
+
+    // Logical processors of each core
+    std::vector< std::pair<WORD, KAFFINITY> > vCore;
+    std::vector<char> vBuf;
+    if (QueryProcessorInfo(RelationProcessorCore, vBuf))
+    {
+        for (std::size_t nOff = 0; nOff < vBuf.size(); )
+        {
+            const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX &info(*reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(&vBuf[nOff]));
+            for (WORD g = 0; g < info.Processor.GroupCount; ++g)
+                vCore.push_back(std::make_pair(info.Processor.GroupMask[g].Group, info.Processor.GroupMask[g].Mask));
+
+            nOff += info.Size;
+        }
+    }
+
+    if (vCore.size() && QueryProcessorInfo(RelationNumaNode, vBuf))
+    {
+        for (std::size_t nOff = 0; nOff < vBuf.size(); )
+        {
+            const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX &info(*reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(&vBuf[nOff]));
+            nOff += info.Size;
+
+            SNode node;
+            node.group = info.NumaNode.GroupMask.Group;
+            node.mask = info.NumaNode.GroupMask.Mask;
+
+            // The k-th logical processor of every core in turn
+            for (int k = 0; ; ++k)
+            {
+                bool bFound(false);
+                for (std::size_t i = 0; i < vCore.size(); ++i)
+                {
+                    const int nBit((vCore[i].first == node.group) ? GetSetBit(vCore[i].second & node.mask, k) : -1);
+                    if (nBit < 0)
+                        continue;
+
+                    node.vProc.push_back((BYTE)nBit);
+                    bFound = true;
+                }
+
+                if (!bFound)
+                    break;
+
+                // Every core of the node has a first logical processor
+                if (k == 0)
+                    m_nCores += (int)node.vProc.size();
+            }
+
+            if (node.vProc.empty())
+                continue;
+
+            m_nProc += (int)node.vProc.size();
+            m_vNode.push_back(node);
+        }
+    }
+
+    if (m_vNode.empty())
+    {
+        SYSTEM_INFO sysinfo;
+        GetSystemInfo(&sysinfo);
+
+        SNode node;
+        node.group = 0;
+        node.mask = (KAFFINITY)sysinfo.dwActiveProcessorMask;
+        for (int k = 0, nBit = 0; (nBit = GetSetBit(node.mask, k)) >= 0; ++k)
+            node.vProc.push_back((BYTE)nBit);
+
+        m_nProc = m_nCores = (int)node.vProc.size();
+        m_vNode.push_back(node);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+int CpuTopology::GetNodeCount() const
+{
+    return (int)m_vNode.size();
+}
+
+//-------------------------------------------------------------------------------------------
+int CpuTopology::GetProcessorCount() const
+{
+    return m_nProc;
+}
+
+//-------------------------------------------------------------------------------------------
+int CpuTopology::GetCoreCount() const
+{
+    return m_nCores;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Node a worker is pinned to.
+    \param nWorker Index of the worker.
+    \param nWorkers Total number of workers.
+    */
+int CpuTopology::GetWorkerNode(int nWorker, int nWorkers) const
+{
+    int nIndex(0);
+    return LocateWorker(nWorker, nWorkers, nIndex);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Restrict a worker thread to its node or to a single logical processor.
+    \param hThread The worker thread.
+    \param nWorker Index of the worker.
+    \param nWorkers Total number of workers.
+    \param bCore Pin to a single logical processor instead of all processors of the node.
+    */
+bool CpuTopology::PinWorker(HANDLE hThread, int nWorker, int nWorkers, bool bCore) const
+{
+    if (m_vNode.empty())
+        return false;
+
+    int nIndex(0);
+    const SNode &node(m_vNode[LocateWorker(nWorker, nWorkers, nIndex)]);
+    const BYTE nProc(node.vProc[nIndex % node.vProc.size()]);
+    return Pin(hThread, node.group, bCore ? ((KAFFINITY)1 << nProc) : node.mask, nProc);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Restrict a thread to the processors of a node. */
+bool CpuTopology::PinToNode(HANDLE hThread, int nNode) const
+{
+    if (nNode < 0 || nNode >= (int)m_vNode.size())
+        return false;
+
+    const SNode &node(m_vNode[nNode]);
+    return Pin(hThread, node.group, node.mask, node.vProc[0]);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Node of a worker and the index of the worker among the workers of that node.
+
+  Node i gets the workers [W * P_i / P, W * P_(i+1) / P) where P_i is the number of logical
+  processors of the nodes before node i.
+  */
+int CpuTopology::LocateWorker(int nWorker, int nWorkers, int &nIndex) const
+{
+    nIndex = nWorker;
+    if (m_vNode.size() <= 1 || nWorkers <= 0 || m_nProc <= 0)
+        return 0;
+
+    int nProc(0);
+    for (std::size_t i = 0; i < m_vNode.size(); ++i)
+    {
+        const int nFirst((int)((long long)nWorkers * nProc / m_nProc));
+        nProc += (int)m_vNode[i].vProc.size();
+        if (nWorker < (int)((long long)nWorkers * nProc / m_nProc))
+        {
+            nIndex = nWorker - nFirst;
+            return (int)i;
+        }
+    }
+
+    return (int)m_vNode.size() - 1;
+}
+
+//-------------------------------------------------------------------------------------------
+bool CpuTopology::Pin(HANDLE hThread, WORD nGroup, KAFFINITY nMask, BYTE nIdeal)
+{
+    GROUP_AFFINITY affinity = GROUP_AFFINITY();
+    affinity.Group = nGroup;
+    affinity.Mask = nMask;
+    if (!SetThreadGroupAffinity(hThread, &affinity, nullptr))
+        return false;
+
+    PROCESSOR_NUMBER ideal = PROCESSOR_NUMBER();
+    ideal.Group = nGroup;
+    ideal.Number = nIdeal;
+    return SetThreadIdealProcessorEx(hThread, &ideal, nullptr) != FALSE;
+}
@@ -0,0 +1,51 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <vector>
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief NUMA nodes and processor cores of the machine.
+
+  The workers are distributed over the nodes in proportion to their number of logical
+  processors. Within a node they take one logical processor per core first, the
+  hyperthreading siblings are only used once every core has a worker.
+
+  Memory of a thread is allocated on the node of the processor it runs on when a page
+  is touched the first time, pinning a thread to a node before it touches memory keeps
+  its pages local.
+  */
+class CpuTopology
+{
+public:
+    CpuTopology();
+    ~CpuTopology();
+
+    void Discover();
+    int GetNodeCount() const;
+    int GetProcessorCount() const;
+    int GetCoreCount() const;
+    int GetWorkerNode(int nWorker, int nWorkers) const;
+    bool PinWorker(HANDLE hThread, int nWorker, int nWorkers, bool bCore) const;
+    bool PinToNode(HANDLE hThread, int nNode) const;
+
+private:
+    struct SNode
+    {
+        WORD group;                 ///< Processor group of the node
+        KAFFINITY mask;             ///< Logical processors of the node within the group
+        std::vector<BYTE> vProc;    ///< Logical processors, one per core first, then the siblings
+    };
+
+    std::vector<SNode> m_vNode;
+    int m_nProc;                    ///< Total number of logical processors
+    int m_nCores;                   ///< Total number of processor cores
+
+    int LocateWorker(int nWorker, int nWorkers, int &nIndex) const;
+    static bool Pin(HANDLE hThread, WORD nGroup, KAFFINITY nMask, BYTE nIdeal);
+
+    CpuTopology(const CpuTopology &ref);
+    CpuTopology& operator=(const CpuTopology &ref);
+};
+
+#endif // include guard
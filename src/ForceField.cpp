@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "ForceField.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "utils/muGeneric.h"
+#include "Source.h"
+
+#if defined(min) || defined(max)
+#undef min
+#undef max
+#endif
+
+
+//-------------------------------------------------------------------------------------------
+ForceField::ForceField()
+    :m_nRes(0)
+    ,m_nNodes(0)
+    ,m_fCellWidth(0)
+    ,m_fCellHeight(0)
+    ,m_vAccX()
+    ,m_vAccY()
+    ,m_vExact()
+{}
+
+//-------------------------------------------------------------------------------------------
+ForceField::~ForceField()
+{}
+
+//-------------------------------------------------------------------------------------------
+int ForceField::GetRes() const
+{
+    return m_nRes;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Sample the acceleration field of the sources.
+    \param vpSrc The sources.
+    \param fSimWidth Width of the simulation field.
+    \param fSimHeight Height of the simulation field.
+    \param fHeight Height of the pendulum above the source plane.
+    \param nRes Number of cells per dimension.
+    \param fExactDist Multiple of max(SIZE, PEND_HEIGHT) around a source in which the
+                      field is evaluated exactly, at least 1 so the capture radius of
+                      the source is covered. Linear sources only need their SIZE.
+    */
+void ForceField::Create(const std::vector<ISource*> &vpSrc,
+                        double fSimWidth,
+                        double fSimHeight,
+                        double fHeight,
+                        int nRes,
+                        double fExactDist)
+{
+    using std::sqrt;
+    using mu::sqr;
+
+    assert(nRes > 0);
+
+    m_nRes = nRes;
+    m_nNodes = nRes + 3;  // one node of border on the lower and two on the upper end
+    m_fCellWidth = fSimWidth / nRes;
+    m_fCellHeight = fSimHeight / nRes;
+    m_vAccX.assign(m_nNodes * m_nNodes, 0);
+    m_vAccY.assign(m_nNodes * m_nNodes, 0);
+    m_vExact.assign(m_nRes * m_nRes, 0);
+
+    // Sample the field at the nodes
+    mu::vec2d_type r, force;
+    for (int j = 0; j < m_nNodes; ++j)
+    {
+        for (int i = 0; i < m_nNodes; ++i)
+        {
+            const double x((i - 1) * m_fCellWidth),
+                         y((j - 1) * m_fCellHeight);
+            double &ax(m_vAccX[j * m_nNodes + i]),
+                   &ay(m_vAccY[j * m_nNodes + i]);
+
+            for (std::size_t k = 0; k < vpSrc.size(); ++k)
+            {
+                const ISource *pSrc(vpSrc[k]);
+                r[0] = x - pSrc->GetPos()[0];
+                r[1] = y - pSrc->GetPos()[1];
+
+                const double dist(sqrt(sqr(r[0]) + sqr(r[1]) + sqr(fHeight)));
+                pSrc->QueryForce(force, r, dist);
+                ax -= force[0];
+                ay -= force[1];
+            }
+        }
+    }
+
+    // Flag cells whose interpolation stencil comes close to a source. The field of linear
+    // sources is reproduced exactly by the cubic interpolation, only their capture radius
+    // SIZE must be evaluated exactly.
+    for (std::size_t k = 0; k < vpSrc.size(); ++k)
+    {
+        const ISource *pSrc(vpSrc[k]);
+        const double fDist((pSrc->GetType() == ISource::tpLIN) ? pSrc->GetSize() : fExactDist * std::max(pSrc->GetSize(), fHeight));
+        if (fDist <= 0)
+            continue;
+
+        for (int cy = 0; cy < m_nRes; ++cy)
+        {
+            const double y0((cy - 1) * m_fCellHeight), y1((cy + 2) * m_fCellHeight),
+                         dy(std::max(0.0, std::max(y0 - pSrc->GetPos()[1], pSrc->GetPos()[1] - y1)));
+            if (dy > fDist)
+                continue;
+
+            for (int cx = 0; cx < m_nRes; ++cx)
+            {
+                const double x0((cx - 1) * m_fCellWidth), x1((cx + 2) * m_fCellWidth),
+                             dx(std::max(0.0, std::max(x0 - pSrc->GetPos()[0], pSrc->GetPos()[0] - x1)));
+                if (sqr(dx) + sqr(dy) <= sqr(fDist))
+                    m_vExact[cy * m_nRes + cx] = 1;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Interpolate the acceleration at a given position.
+    \return false if the position requires exact evaluation, acc is not touched in this case.
+    */
+bool ForceField::QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc) const
+{
+    if (!m_nRes)
+        return false;
+
+    const double fx(pos[0] / m_fCellWidth),
+                 fy(pos[1] / m_fCellHeight);
+    if (fx < 0 || fy < 0 || fx >= m_nRes || fy >= m_nRes)
+        return false;
+
+    const int cx((int)fx), cy((int)fy);
+    if (m_vExact[cy * m_nRes + cx])
+        return false;
+
+    // Catmull-Rom weights
+    const double tx(fx - cx), ty(fy - cy);
+    const double wx[4] = { 0.5 * ((-tx + 2) * tx - 1) * tx,
+                           0.5 * ((3 * tx - 5) * tx * tx + 2),
+                           0.5 * ((-3 * tx + 4) * tx + 1) * tx,
+                           0.5 * (tx - 1) * tx * tx };
+    const double wy[4] = { 0.5 * ((-ty + 2) * ty - 1) * ty,
+                           0.5 * ((3 * ty - 5) * ty * ty + 2),
+                           0.5 * ((-3 * ty + 4) * ty + 1) * ty,
+                           0.5 * (ty - 1) * ty * ty };
+
+    // The node of cell (cx, cy) is at index (cx+1, cy+1) due to the border
+    double ax(0), ay(0);
+    for (int j = 0; j < 4; ++j)
+    {
+        const double *pX(&m_vAccX[(cy + j) * m_nNodes + cx]),
+                     *pY(&m_vAccY[(cy + j) * m_nNodes + cx]);
+
+        ax += wy[j] * (wx[0] * pX[0] + wx[1] * pX[1] + wx[2] * pX[2] + wx[3] * pX[3]);
+        ay += wy[j] * (wx[0] * pY[0] + wx[1] * pY[1] + wx[2] * pY[2] + wx[3] * pY[3]);
+    }
+
+    acc[0] = ax;
+    acc[1] = ay;
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef FORCE_FIELD_H
+#define FORCE_FIELD_H
+
+#include <vector>
+#include "utils/muVector.h"
+
+//-------------------------------------------------------------------------------------------
+// Forward declarations
+class ISource;
+
+//-------------------------------------------------------------------------------------------
+/** \brief Precomputed acceleration field of all sources.
+
+  The acceleration caused by the sources is sampled once on a regular grid covering the
+  simulation field and interpolated bicubically (Catmull-Rom) afterwards. Cells close to a
+  source are flagged for exact evaluation because the field gradients explode there.
+  Queries in these cells or outside of the simulation field are rejected and must be
+  computed by summing up the sources.
+  */
+class ForceField
+{
+public:
+    ForceField();
+    ~ForceField();
+
+    void Create(const std::vector<ISource*> &vpSrc,
+                double fSimWidth,
+                double fSimHeight,
+                double fHeight,
+                int nRes,
+                double fExactDist);
+    bool QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc) const;
+    int GetRes() const;
+
+private:
+    int m_nRes;                             ///< Number of cells per dimension
+    int m_nNodes;                           ///< Number of nodes per dimension including the border
+    double m_fCellWidth;
+    double m_fCellHeight;
+    std::vector<double> m_vAccX;            ///< x component of the acceleration at the nodes
+    std::vector<double> m_vAccY;            ///< y component of the acceleration at the nodes
+    std::vector<unsigned char> m_vExact;    ///< Flags for cells requiring exact evaluation
+
+    ForceField(const ForceField &ref);
+    ForceField& operator=(const ForceField &ref);
+};
+
+#endif // include guard
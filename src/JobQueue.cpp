@@ -0,0 +1,363 @@
+#include "stdafx.h"
+#include "JobQueue.h"
+
+//--- Standard includes ---------------------------------------------------------------------
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+//--- Utility classes -----------------------------------------------------------------------
+#include "utils/auThreads.h"
+#include "utils/suUtility.h"
+#include "utils/utMemory.h"
+#include "utils/utWideExceptions.h"
+
+
+//-------------------------------------------------------------------------------------------
+JobQueue::JobQueue()
+    :m_vJobs()
+    ,m_Lock()
+{}
+
+//-------------------------------------------------------------------------------------------
+JobQueue::~JobQueue()
+{
+    for (std::size_t i = 0; i < m_vJobs.size(); ++i)
+        delete m_vJobs[i]->pSim;
+
+    utils::clear_cont_of_ptr(m_vJobs);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns true if the command line argument is a directory or a job list file.
+
+  Job lists have the extension ".jobs" and contain one configuration file per line.
+  */
+bool JobQueue::IsJobList(const std::wstring &sArg)
+{
+    DWORD dwAttr(GetFileAttributes(sArg.c_str()));
+    if (dwAttr != INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_DIRECTORY))
+        return true;
+
+    return sArg.length() > 5 && su::to_upper(sArg.substr(sArg.length() - 5)) == _T(".JOBS");
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add a single configuration file, results are written next to it. */
+void JobQueue::AddJob(const std::wstring &sFile)
+{
+    au::IniFile config;
+    config.Load(sFile, au::IniFile::eIGNORE_CASE);
+
+    wchar_t szName[2048], szDrive[2048], szDir[2048];
+    _wsplitpath(sFile.c_str(), szDrive, szDir, szName, NULL);
+    std::wstringstream ss;
+    ss << szDrive << szDir;
+
+    SJob *pJob(new SJob);
+    pJob->pSim = nullptr;
+    pJob->sPath = ss.str();
+    pJob->sName = szName;
+    pJob->fCost = 0;
+    pJob->bDone = false;
+    m_vJobs.push_back(pJob);
+
+    try
+    {
+        pJob->pSim = new SimImpl(nullptr, config);
+        pJob->fCost = pJob->pSim->EstimateCost();
+    }
+    catch (utils::wruntime_error &e)
+    {
+        throw utils::wruntime_error(sFile + _T(": ") + e.message());
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add all configuration files (*.cfg) of a directory. */
+void JobQueue::AddDirectory(const std::wstring &sDir)
+{
+    std::wstring sBase(sDir);
+    if (sBase.length() && sBase[sBase.length() - 1] != _T('\\'))
+        sBase += _T("\\");
+
+    std::vector<std::wstring> vFiles;
+    WIN32_FIND_DATA data;
+    HANDLE hFind(FindFirstFile((sBase + _T("*.cfg")).c_str(), &data));
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                vFiles.push_back(sBase + data.cFileName);
+        } while (FindNextFile(hFind, &data));
+
+        FindClose(hFind);
+    }
+
+    // The job order is set by Run, sorting here only makes the log reproducible
+    std::sort(vFiles.begin(), vFiles.end());
+    for (std::size_t i = 0; i < vFiles.size(); ++i)
+        AddJob(vFiles[i]);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add the configuration files of a job list.
+
+  Empty lines and lines starting with ';' are ignored. Relative paths are relative
+  to the directory of the job list.
+  */
+void JobQueue::AddList(const std::wstring &sFile)
+{
+    std::wifstream ifs(sFile.c_str());
+    if (!ifs)
+        throw utils::wruntime_error(_T("Can't open job list: ") + sFile);
+
+    wchar_t szDrive[2048], szDir[2048];
+    _wsplitpath(sFile.c_str(), szDrive, szDir, NULL, NULL);
+    std::wstring sBase(std::wstring(szDrive) + szDir);
+
+    std::wstring sLine;
+    while (std::getline(ifs, sLine))
+    {
+        sLine = su::trim(sLine);
+        sLine = su::unquote(sLine);
+        if (!sLine.length() || sLine[0] == _T(';'))
+            continue;
+
+        bool bAbsolute(sLine[0] == _T('\\') || (sLine.length() > 1 && sLine[1] == _T(':')));
+        AddJob(bAbsolute ? sLine : sBase + sLine);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+std::size_t JobQueue::GetJobCount() const
+{
+    return m_vJobs.size();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate all jobs, blocks until the results of all jobs are written.
+    \param nThreads Number of worker threads, -1 for one thread per processor.
+    */
+void JobQueue::Run(int nThreads)
+{
+    if (m_vJobs.empty())
+        throw utils::wruntime_error(_T("The job list is empty."));
+
+    // Longest processing time first
+    std::stable_sort(m_vJobs.begin(), m_vJobs.end(), [](const SJob *a, const SJob *b)
+    {
+        return a->fCost > b->fCost;
+    });
+
+    for (std::size_t i = 0; i < m_vJobs.size(); ++i)
+    {
+        SJob &job(*m_vJobs[i]);
+        job.pSim->RunPrecisionCheck(job.sPath, job.sName);
+        job.pSim->Restore(job.sPath, job.sName);
+        TRACE(_T("Job %d: %s (cost %.3g)\n"), (int)i, job.sName.c_str(), job.fCost);
+
+        // A complete checkpoint or tile cache leaves no work, no worker would finish the job
+        if (FinishJob(job))
+            job.pSim->DumpToFile(job.sPath, job.sName);
+    }
+
+    if (IsDone())
+        return;
+
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    if (nThreads <= 0)
+        nThreads = (int)sysinfo.dwNumberOfProcessors;
+
+    // The threads are started suspended, a thread finishing before m_bAutoDelete is
+    // cleared would delete itself
+    std::vector<CWinThread*> vThreads;
+    for (int i = 0; i < nThreads; ++i)
+    {
+        CWinThread *pNewThread(AfxBeginThread(ThreadMain,
+            reinterpret_cast<LPVOID>(this),
+            THREAD_PRIORITY_NORMAL,
+            0,  // default stack size
+            CREATE_SUSPENDED,
+            NULL));
+        if (!pNewThread)
+            continue;
+
+        pNewThread->m_bAutoDelete = FALSE;
+        pNewThread->ResumeThread();
+        vThreads.push_back(pNewThread);
+    }
+
+    if (vThreads.empty())
+        throw utils::wruntime_error(_T("Can't create worker threads."));
+
+    // WaitForMultipleObjects is limited to 64 handles
+    for (std::size_t i = 0; i < vThreads.size(); ++i)
+    {
+        WaitForSingleObject(vThreads[i]->m_hThread, INFINITE);
+        delete vThreads[i];
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Find the next line to calculate.
+    \return false if there is no work available right now.
+
+    Lines are taken from the first job in cost order that has lines left. Once all lines
+    are handed out the straggler queues of the jobs are processed. Jobs without any work
+    left are finished and written here.
+    */
+bool JobQueue::QueryWork(SJob *&pJob, int &y, int &hLine, bool &bStraggler, SimImpl::SPendState &straggler)
+{
+    for (std::size_t i = 0; i < m_vJobs.size(); ++i)
+    {
+        SJob &job(*m_vJobs[i]);
+        if (job.bDone)
+            continue;
+
+        int nCols(0), nRows(0);
+        job.pSim->QuerySimGrid(nCols, nRows);
+        hLine = job.pSim->QueryNextLine(y);
+        if (y >= 0 && y < nRows)
+        {
+            pJob = &job;
+            bStraggler = false;
+            return true;
+        }
+
+        // No worker is going to flag a line of this job as done
+        if (FinishJob(job))
+        {
+            job.pSim->DumpToFile(job.sPath, job.sName);
+            TRACE(_T("Job finished: %s\n"), job.sName.c_str());
+        }
+    }
+
+    for (std::size_t i = 0; i < m_vJobs.size(); ++i)
+    {
+        SJob &job(*m_vJobs[i]);
+        if (!job.bDone && job.pSim->QueryStraggler(straggler))
+        {
+            pJob = &job;
+            bStraggler = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------
+bool JobQueue::IsDone() const
+{
+    for (std::size_t i = 0; i < m_vJobs.size(); ++i)
+    {
+        if (!m_vJobs[i]->bDone)
+            return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Flag a job as done once all of its passes are finished.
+    \return true if the job has just been finished and its results need to be written.
+    */
+bool JobQueue::FinishJob(SJob &job)
+{
+    if (job.bDone || !job.pSim->IsDone())
+        return false;
+
+    // Animations continue with the next frame
+    if (job.pSim->FinishFrame(job.sPath, job.sName))
+        return false;
+
+    job.bDone = true;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+UINT JobQueue::ThreadMain(LPVOID lpParam)
+{
+    JobQueue *pSelf(static_cast<JobQueue*>(lpParam));
+
+    try
+    {
+        SimImpl::SPendState straggler;
+        for (;;)
+        {
+            SJob *pJob(nullptr);
+            int y(0), hLine(0);
+            bool bStraggler(false), bWork(false);
+            {
+                au::AutoLock<CCriticalSection> lock(&pSelf->m_Lock);
+                if (pSelf->IsDone())
+                    break;
+
+                bWork = pSelf->QueryWork(pJob, y, hLine, bStraggler, straggler);
+            }
+
+            // Other threads may still work on the last lines of a pass
+            if (!bWork)
+            {
+                Sleep(10);
+                continue;
+            }
+
+            SimImpl &sim(*pJob->pSim);
+            if (bStraggler)
+            {
+                sim.ResumeStraggler(straggler);
+            }
+            else if (sim.IsResumePass())
+            {
+                sim.ResumeLine(y);
+            }
+            else
+            {
+                int nCols(0), nRows(0);
+                sim.QuerySimGrid(nCols, nRows);
+                for (int x = 0; x < nCols; ++x)
+                {
+                    // symmetric images are filled in by their counterpart
+                    if (sim.NeedsCalc(x, y))
+                        sim.CalcPixel(x, y);
+                }
+            }
+
+            bool bFinished(false);
+            {
+                au::AutoLock<CCriticalSection> lock(&pSelf->m_Lock);
+                if (bStraggler)
+                    sim.FlagStragglerDone(straggler.y);
+                else
+                    sim.FlagAsDone(hLine);
+
+                bFinished = pSelf->FinishJob(*pJob);
+            }
+
+            // Only one thread sees the job finishing, no lock needed for writing
+            if (bFinished)
+            {
+                sim.DumpToFile(pJob->sPath, pJob->sName);
+                TRACE(_T("Job finished: %s\n"), pJob->sName.c_str());
+            }
+        }
+    }
+    catch (utils::wruntime_error &e)
+    {
+        AfxMessageBox(e.message().c_str());
+    }
+    catch (std::exception &)
+    {
+        AfxMessageBox(_T("unexpected exception!"));
+    }
+    catch (...)
+    {
+        AfxMessageBox(_T("unexpected exception: closing thread."));
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+//-------------------------------------------------------------------------------------------
+#include <afxmt.h>
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------
+#include "utils/auIniFile.h"
+
+//---------------------------------------------------------------------------------------
+#include "SimPend.h"
+
+//-------------------------------------------------------------------------------------------
+/** \brief Headless calculation of many configurations on a shared pool of worker threads.
+
+  Each configuration file is a job with its own simulation, output bitmap and checkpoint
+  next to the configuration file. The lines of all jobs are handed out to a single pool
+  of worker threads. Jobs are ordered by their estimated cost, largest first, so the
+  lines of small jobs fill the tails of the large ones instead of leaving cores idle.
+  */
+class JobQueue
+{
+public:
+    JobQueue();
+    ~JobQueue();
+
+    void AddJob(const std::wstring &sFile);
+    void AddDirectory(const std::wstring &sDir);
+    void AddList(const std::wstring &sFile);
+    std::size_t GetJobCount() const;
+    void Run(int nThreads);
+
+    static bool IsJobList(const std::wstring &sArg);
+
+private:
+    struct SJob
+    {
+        SimImpl *pSim;          ///< The simulation, runs without a window
+        std::wstring sPath;     ///< Directory of the configuration file
+        std::wstring sName;     ///< Name of the configuration file without extension
+        double fCost;           ///< Estimated cost, used for the job order
+        bool bDone;             ///< True once the results are written
+    };
+
+    std::vector<SJob*> m_vJobs;
+    CCriticalSection m_Lock;
+
+    static UINT ThreadMain(LPVOID lpParam);
+    bool QueryWork(SJob *&pJob, int &y, int &hLine, bool &bStraggler, SimImpl::SPendState &straggler);
+    bool IsDone() const;
+    bool FinishJob(SJob &job);
+
+    JobQueue(const JobQueue &ref);
+    JobQueue& operator=(const JobQueue &ref);
+};
+
+#endif // include guard
@@ -0,0 +1,259 @@
+#include "stdafx.h"
+#include "RuntimeMetrics.h"
+
+#include <iomanip>
+#include <sstream>
+
+#include "utils/utWideExceptions.h"
+
+
+namespace
+{
+    /** \brief Counters of the calling thread, null if the thread is not attached. */
+    thread_local RuntimeMetrics::SCounters *g_pCurrent = nullptr;
+
+    //---------------------------------------------------------------------------------------
+    /** \brief Format a rate with a k, M or G suffix. */
+    std::wstring FormatRate(double fRate)
+    {
+        const wchar_t *szUnit[] = { _T(""), _T("k"), _T("M"), _T("G") };
+        int i(0);
+        for (; i < 3 && fRate >= 1000; ++i)
+            fRate /= 1000;
+
+        std::wstringstream ss;
+        ss << std::fixed << std::setprecision((fRate < 100) ? 1 : 0) << fRate << szUnit[i];
+        return ss.str();
+    }
+}
+
+
+//-------------------------------------------------------------------------------------------
+RuntimeMetrics::RuntimeMetrics()
+    :m_vSlot()
+    ,m_fFreq(1)
+    ,m_ofs()
+    ,m_nStart(0)
+    ,m_nLastTime(0)
+    ,m_Last()
+    ,m_Delta()
+    ,m_vLast()
+    ,m_bufSec()
+    ,m_bufPixels()
+    ,m_bufSteps()
+{
+    LARGE_INTEGER nFreq;
+    QueryPerformanceFrequency(&nFreq);
+    m_fFreq = (double)nFreq.QuadPart;
+}
+
+//-------------------------------------------------------------------------------------------
+RuntimeMetrics::~RuntimeMetrics()
+{}
+
+//-------------------------------------------------------------------------------------------
+void RuntimeMetrics::Reset()
+{
+    m_vSlot.clear();
+    m_vLast.clear();
+    m_nStart = 0;
+    m_nLastTime = 0;
+    m_Last = SCounters();
+    m_Delta = SCounters();
+
+    if (m_ofs.is_open())
+        m_ofs.close();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Create one slot of counters per worker thread. */
+void RuntimeMetrics::Create(int nThreads)
+{
+    if (nThreads <= 0)
+        throw utils::wruntime_error(_T("Number of metric slots must be greater then zero."));
+
+    Reset();
+    m_vSlot.assign(nThreads, SSlot());
+    m_vLast.assign(nThreads, SCounters());
+    m_bufSec.Reset(WINDOW, 0);
+    m_bufPixels.Reset(WINDOW, 0);
+    m_bufSteps.Reset(WINDOW, 0);
+    m_nStart = m_nLastTime = Now();
+}
+
+//-------------------------------------------------------------------------------------------
+bool RuntimeMetrics::IsCreated() const
+{
+    return m_vSlot.size() != 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Write every sample to a tab separated file. */
+void RuntimeMetrics::Open(const std::wstring &sFile)
+{
+    m_ofs.open(sFile.c_str(), std::ios::out | std::ios::trunc);
+    if (!m_ofs)
+        throw utils::wruntime_error(_T("Can't open the metrics file."));
+
+    m_ofs << _T("# times in seconds, counters are totals since the start\n")
+          << _T("# rates: last interval per thread, average of the last ") << (int)WINDOW << _T(" intervals for all\n")
+          << _T("time\tthread\tbusy\tdraw\tdata_wait\tpaint_wait\tidle\tpixels\tsteps\tpixels_per_s\tsteps_per_s")
+          << std::endl;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Bind a slot to the calling worker thread.
+    \return The counters of the slot, only the calling thread may write them.
+    */
+RuntimeMetrics::SCounters& RuntimeMetrics::Attach(int nSlot)
+{
+    ASSERT(nSlot >= 0 && nSlot < (int)m_vSlot.size());
+
+    g_pCurrent = &m_vSlot[nSlot].c;
+    return *g_pCurrent;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Stop counting the work of the calling thread. */
+void RuntimeMetrics::Detach()
+{
+    g_pCurrent = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Take a sample of all counters and write it to the metrics file. */
+void RuntimeMetrics::Sample()
+{
+    if (!IsCreated())
+        return;
+
+    const long long nNow(Now());
+    const SCounters sum(Sum(m_vSlot));
+    const double fSec((nNow - m_nLastTime) / m_fFreq);
+
+    m_Delta.busy = sum.busy - m_Last.busy;
+    m_Delta.draw = sum.draw - m_Last.draw;
+    m_Delta.data_wait = sum.data_wait - m_Last.data_wait;
+    m_Delta.paint_wait = sum.paint_wait - m_Last.paint_wait;
+    m_Delta.idle = sum.idle - m_Last.idle;
+    m_Delta.pixels = sum.pixels - m_Last.pixels;
+    m_Delta.steps = sum.steps - m_Last.steps;
+
+    m_bufSec.Push(fSec);
+    m_bufPixels.Push((double)m_Delta.pixels);
+    m_bufSteps.Push((double)m_Delta.steps);
+
+    if (m_ofs.is_open())
+    {
+        const double fTime((nNow - m_nStart) / m_fFreq);
+        for (std::size_t i = 0; i < m_vSlot.size(); ++i)
+        {
+            const SCounters c(m_vSlot[i].c);
+            Write(fTime,
+                  std::to_wstring(i),
+                  c,
+                  (fSec > 0) ? (c.pixels - m_vLast[i].pixels) / fSec : 0,
+                  (fSec > 0) ? (c.steps - m_vLast[i].steps) / fSec : 0);
+            m_vLast[i] = c;
+        }
+
+        const double fWinSec(m_bufSec.MeanValue());
+        Write(fTime,
+              _T("all"),
+              sum,
+              (fWinSec > 0) ? m_bufPixels.MeanValue() / fWinSec : 0,
+              (fWinSec > 0) ? m_bufSteps.MeanValue() / fWinSec : 0);
+        m_ofs.flush();
+    }
+
+    m_Last = sum;
+    m_nLastTime = nNow;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Throughput averaged over the last samples and the time shares of the last interval. */
+std::wstring RuntimeMetrics::GetSummary() const
+{
+    if (!IsCreated())
+        return std::wstring();
+
+    // MeanValue is not const, the buffers are copied into sums here
+    double fSec(0), fPixels(0), fSteps(0);
+    for (unsigned i = 0; i < m_bufSec.Size(); ++i)
+    {
+        fSec += m_bufSec[i];
+        fPixels += m_bufPixels[i];
+        fSteps += m_bufSteps[i];
+    }
+
+    const double fTicks((double)(m_Delta.busy + m_Delta.draw + m_Delta.data_wait + m_Delta.idle));
+    const double fShare((fTicks > 0) ? 100 / fTicks : 0);
+
+    std::wstringstream ss;
+    ss << FormatRate((fSec > 0) ? fPixels / fSec : 0) << _T(" px/s, ")
+       << FormatRate((fSec > 0) ? fSteps / fSec : 0) << _T(" steps/s, ")
+       << std::fixed << std::setprecision(0)
+       << _T("busy ") << m_Delta.busy * fShare << _T("%, ")
+       << _T("draw ") << m_Delta.draw * fShare << _T("%, ")
+       << _T("lock wait ") << (m_Delta.data_wait + m_Delta.paint_wait) * fShare << _T("%, ")
+       << _T("idle ") << m_Delta.idle * fShare << _T("%");
+    return ss.str();
+}
+
+//-------------------------------------------------------------------------------------------
+long long RuntimeMetrics::Now()
+{
+    LARGE_INTEGER nTime;
+    QueryPerformanceCounter(&nTime);
+    return nTime.QuadPart;
+}
+
+//-------------------------------------------------------------------------------------------
+void RuntimeMetrics::AddSteps(long long nSteps)
+{
+    if (g_pCurrent)
+        g_pCurrent->steps += nSteps;
+}
+
+//-------------------------------------------------------------------------------------------
+void RuntimeMetrics::AddPaintWait(long long nTicks)
+{
+    if (g_pCurrent)
+        g_pCurrent->paint_wait += nTicks;
+}
+
+//-------------------------------------------------------------------------------------------
+RuntimeMetrics::SCounters RuntimeMetrics::Sum(const std::vector<SSlot> &vSlot)
+{
+    SCounters sum = SCounters();
+    for (std::size_t i = 0; i < vSlot.size(); ++i)
+    {
+        const SCounters &c(vSlot[i].c);
+        sum.busy += c.busy;
+        sum.draw += c.draw;
+        sum.data_wait += c.data_wait;
+        sum.paint_wait += c.paint_wait;
+        sum.idle += c.idle;
+        sum.pixels += c.pixels;
+        sum.steps += c.steps;
+    }
+
+    return sum;
+}
+
+//-------------------------------------------------------------------------------------------
+void RuntimeMetrics::Write(double fTime, const std::wstring &sThread, const SCounters &c, double fPixRate, double fStepRate)
+{
+    m_ofs << std::fixed << std::setprecision(3)
+          << fTime << _T("\t")
+          << sThread << _T("\t")
+          << c.busy / m_fFreq << _T("\t")
+          << c.draw / m_fFreq << _T("\t")
+          << c.data_wait / m_fFreq << _T("\t")
+          << c.paint_wait / m_fFreq << _T("\t")
+          << c.idle / m_fFreq << _T("\t")
+          << c.pixels << _T("\t")
+          << c.steps << _T("\t")
+          << std::setprecision(0) << fPixRate << _T("\t")
+          << fStepRate << _T("\n");
+}
@@ -0,0 +1,112 @@
+#ifndef RUNTIME_METRICS_H
+#define RUNTIME_METRICS_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <atomic>
+
+#include "utils/auStatBuffer.h"
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Low overhead runtime metrics of the worker threads.
+
+  Each worker attaches to a slot of counters that only it writes, so updating them needs
+  neither a lock nor an interlocked operation. The UI thread samples the counters
+  periodically without a lock, a sample may miss the work of the line in progress which
+  is irrelevant for monitoring.
+
+  Times are measured in performance counter ticks. The integration steps and the paint
+  lock wait are reported through static functions to the slot of the calling thread,
+  threads without a slot (the probe thread, the benchmark) are not counted.
+  */
+class RuntimeMetrics
+{
+public:
+    /** \brief Counter written by one thread and read by others.
+
+      Plain 64 bit loads and stores may tear on Win32, the value is accessed with relaxed
+      atomic loads and stores. The increment itself is not atomic, only the owning thread
+      may change the counter.
+      */
+    class Counter
+    {
+    public:
+        Counter(long long n = 0) : m_n(n) {}
+        Counter(const Counter &ref) : m_n(ref.Get()) {}
+        Counter& operator=(const Counter &ref) { Set(ref.Get()); return *this; }
+        Counter& operator+=(long long n) { Set(Get() + n); return *this; }
+        Counter& operator++() { return *this += 1; }
+        operator long long() const { return Get(); }
+
+    private:
+        std::atomic<long long> m_n;
+
+        long long Get() const { return m_n.load(std::memory_order_relaxed); }
+        void Set(long long n) { m_n.store(n, std::memory_order_relaxed); }
+    };
+
+    struct SCounters
+    {
+        Counter busy;           ///< Time spent integrating grid points
+        Counter draw;           ///< Time spent holding the data lock, includes paint_wait
+        Counter data_wait;      ///< Time spent waiting for the data lock
+        Counter paint_wait;     ///< Time spent waiting for the paint lock
+        Counter idle;           ///< Time spent sleeping for lack of work
+        Counter pixels;         ///< Grid points integrated, resumed grid points count again
+        Counter steps;          ///< Integration steps
+    };
+
+    enum
+    {
+        WINDOW = 10             ///< Number of samples averaged for the throughput
+    };
+
+    RuntimeMetrics();
+    ~RuntimeMetrics();
+
+    void Reset();
+    void Create(int nThreads);
+    bool IsCreated() const;
+    void Open(const std::wstring &sFile);
+    SCounters& Attach(int nSlot);
+    static void Detach();
+
+    void Sample();
+    std::wstring GetSummary() const;
+
+    static long long Now();
+    static void AddSteps(long long nSteps);
+    static void AddPaintWait(long long nTicks);
+
+private:
+    /** \brief Counters padded so that workers never write the same cache line. */
+    struct SSlot
+    {
+        SCounters c;
+        char pad[128 - sizeof(SCounters)];
+    };
+
+    std::vector<SSlot> m_vSlot;
+    double m_fFreq;                 ///< Performance counter ticks per second
+    std::wofstream m_ofs;           ///< Metrics file, not open if no file is written
+
+    // Sampler state, only used by the UI thread
+    long long m_nStart;             ///< Time of the first sample
+    long long m_nLastTime;          ///< Time of the last sample
+    SCounters m_Last;               ///< Sum of all slots at the last sample
+    SCounters m_Delta;              ///< Change of the sums between the last two samples
+    std::vector<SCounters> m_vLast; ///< Counters of each slot at the last sample
+    au::StatBuffer<double> m_bufSec;    ///< Length of the last sample intervals in seconds
+    au::StatBuffer<double> m_bufPixels; ///< Grid points of the last sample intervals
+    au::StatBuffer<double> m_bufSteps;  ///< Steps of the last sample intervals
+
+    static SCounters Sum(const std::vector<SSlot> &vSlot);
+    void Write(double fTime, const std::wstring &sThread, const SCounters &c, double fPixRate, double fStepRate);
+
+    RuntimeMetrics(const RuntimeMetrics &ref);
+    RuntimeMetrics& operator=(const RuntimeMetrics &ref);
+};
+
+#endif // include guard
@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "SampleCache.h"
+
+#include <cmath>
+#include <fstream>
+
+#include "utils/auThreads.h"
+#include "utils/utWideExceptions.h"
+
+
+namespace
+{
+    const unsigned int CACHE_MAGIC = 0x31435053;   // "SPC1"
+}
+
+
+//-------------------------------------------------------------------------------------------
+SampleCache::SampleCache()
+    :m_mapSamples()
+    ,m_fInvQuantum(0)
+    ,m_nMaxSize(0)
+    ,m_nConfigHash(0)
+    ,m_nHits(0)
+    ,m_Lock()
+{}
+
+//-------------------------------------------------------------------------------------------
+SampleCache::~SampleCache()
+{}
+
+//-------------------------------------------------------------------------------------------
+void SampleCache::Reset()
+{
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    m_mapSamples.clear();
+    m_fInvQuantum = 0;
+    m_nMaxSize = 0;
+    m_nConfigHash = 0;
+    m_nHits = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up an empty cache.
+    \param fQuantum Start positions closer than this are the same sample.
+    \param nMaxSize Maximum number of samples.
+    \param nConfigHash Hash of the simulation parameters the samples are valid for.
+    */
+void SampleCache::Create(double fQuantum, std::size_t nMaxSize, unsigned long long nConfigHash)
+{
+    Reset();
+
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    m_fInvQuantum = 1 / fQuantum;
+    m_nMaxSize = nMaxSize;
+    m_nConfigHash = nConfigHash;
+}
+
+//-------------------------------------------------------------------------------------------
+bool SampleCache::IsCreated() const
+{
+    return m_nMaxSize > 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Change the parameters the samples are valid for.
+
+  All samples are dropped if the hash differs.
+  */
+void SampleCache::SetConfigHash(unsigned long long nConfigHash)
+{
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    if (nConfigHash == m_nConfigHash)
+        return;
+
+    m_mapSamples.clear();
+    m_nConfigHash = nConfigHash;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Look up a sample.
+    \return false if there is no sample for this start position.
+    */
+bool SampleCache::Lookup(const mu::vec2d_type &pos, int &idx, double &len) const
+{
+    const SKey key(MakeKey(pos));
+
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    map_type::const_iterator it(m_mapSamples.find(key));
+    if (it == m_mapSamples.end())
+        return false;
+
+    idx = it->second.idx;
+    len = it->second.len;
+    ++m_nHits;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add a sample, only final results may be added. */
+void SampleCache::Insert(const mu::vec2d_type &pos, int idx, double len)
+{
+    SSample sample;
+    sample.idx = idx;
+    sample.len = len;
+    const SKey key(MakeKey(pos));
+
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    if (m_mapSamples.size() < m_nMaxSize)
+        m_mapSamples[key] = sample;
+}
+
+//-------------------------------------------------------------------------------------------
+std::size_t SampleCache::GetSize() const
+{
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    return m_mapSamples.size();
+}
+
+//-------------------------------------------------------------------------------------------
+std::size_t SampleCache::GetHits() const
+{
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    return m_nHits;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add the samples of a cache file.
+
+  A missing file or a file written with different simulation parameters is ignored.
+  */
+void SampleCache::Load(const std::wstring &sFile)
+{
+    std::fstream file;
+    file.open(sFile.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return;
+
+    unsigned int nMagic(0);
+    unsigned long long nHash(0), nSize(0);
+    file.read(reinterpret_cast<char*>(&nMagic), sizeof(nMagic));
+    file.read(reinterpret_cast<char*>(&nHash), sizeof(nHash));
+    file.read(reinterpret_cast<char*>(&nSize), sizeof(nSize));
+    if (!file || nMagic != CACHE_MAGIC || nHash != m_nConfigHash)
+        return;
+
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    for (unsigned long long i = 0; i < nSize && m_mapSamples.size() < m_nMaxSize; ++i)
+    {
+        SKey key;
+        SSample sample;
+        file.read(reinterpret_cast<char*>(&key.x), sizeof(key.x));
+        file.read(reinterpret_cast<char*>(&key.y), sizeof(key.y));
+        file.read(reinterpret_cast<char*>(&sample.idx), sizeof(sample.idx));
+        file.read(reinterpret_cast<char*>(&sample.len), sizeof(sample.len));
+        if (!file)
+            break;
+
+        m_mapSamples[key] = sample;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+void SampleCache::Save(const std::wstring &sFile) const
+{
+    std::fstream file;
+    file.open(sFile.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+        throw utils::wruntime_error(_T("Cant open file for sample cache output"));
+
+    au::AutoLock<CCriticalSection> lock(&m_Lock);
+    const unsigned long long nSize(m_mapSamples.size());
+    file.write(reinterpret_cast<const char*>(&CACHE_MAGIC), sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&m_nConfigHash), sizeof(m_nConfigHash));
+    file.write(reinterpret_cast<const char*>(&nSize), sizeof(nSize));
+    for (map_type::const_iterator it = m_mapSamples.begin(); it != m_mapSamples.end(); ++it)
+    {
+        file.write(reinterpret_cast<const char*>(&it->first.x), sizeof(it->first.x));
+        file.write(reinterpret_cast<const char*>(&it->first.y), sizeof(it->first.y));
+        file.write(reinterpret_cast<const char*>(&it->second.idx), sizeof(it->second.idx));
+        file.write(reinterpret_cast<const char*>(&it->second.len), sizeof(it->second.len));
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+SampleCache::SKey SampleCache::MakeKey(const mu::vec2d_type &pos) const
+{
+    SKey key;
+    key.x = (long long)std::floor(pos[0] * m_fInvQuantum + 0.5);
+    key.y = (long long)std::floor(pos[1] * m_fInvQuantum + 0.5);
+    return key;
+}
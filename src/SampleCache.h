@@ -0,0 +1,77 @@
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <afxmt.h>
+#include <string>
+#include <unordered_map>
+
+#include "utils/muVector.h"
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Persistent cache of calculated grid points.
+
+  Samples are stored by their start position in model coordinates, rounded to a fixed
+  quantum. Renders of overlapping viewports or of the same region at a different
+  resolution reuse the samples whose start positions coincide. The cache file carries a
+  hash of the simulation parameters, a cache written with different parameters is ignored.
+  */
+class SampleCache
+{
+public:
+    SampleCache();
+    ~SampleCache();
+
+    void Reset();
+    void Create(double fQuantum, std::size_t nMaxSize, unsigned long long nConfigHash);
+    bool IsCreated() const;
+    void SetConfigHash(unsigned long long nConfigHash);
+    bool Lookup(const mu::vec2d_type &pos, int &idx, double &len) const;
+    void Insert(const mu::vec2d_type &pos, int idx, double len);
+    std::size_t GetSize() const;
+    std::size_t GetHits() const;
+    void Load(const std::wstring &sFile);
+    void Save(const std::wstring &sFile) const;
+
+private:
+    struct SKey
+    {
+        long long x;    ///< Quantized x coordinate
+        long long y;    ///< Quantized y coordinate
+
+        bool operator==(const SKey &key) const
+        {
+            return x == key.x && y == key.y;
+        }
+    };
+
+    struct SKeyHash
+    {
+        std::size_t operator()(const SKey &key) const
+        {
+            return std::hash<long long>()(key.x * 0x9E3779B97F4A7C15LL ^ key.y);
+        }
+    };
+
+    struct SSample
+    {
+        int idx;        ///< Index of the closest source
+        double len;     ///< Trace length
+    };
+
+    typedef std::unordered_map<SKey, SSample, SKeyHash> map_type;
+
+    map_type m_mapSamples;
+    double m_fInvQuantum;               ///< Inverse of the position quantum
+    std::size_t m_nMaxSize;             ///< No more samples are inserted once this size is reached
+    unsigned long long m_nConfigHash;   ///< Hash of the simulation parameters
+    mutable std::size_t m_nHits;        ///< Number of successful lookups
+    mutable CCriticalSection m_Lock;
+
+    SKey MakeKey(const mu::vec2d_type &pos) const;
+
+    SampleCache(const SampleCache &ref);
+    SampleCache& operator=(const SampleCache &ref);
+};
+
+#endif // include guard
@@ -12,6 +12,7 @@
 #include "SimApp.h"
 #include "SimPend.h"
 #include "SimThread.h"
+#include "JobQueue.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -54,10 +55,25 @@ BOOL CSimApp::InitInstance()
         std::wstring sFile(CWinApp::m_lpCmdLine);
         if (sFile.length() == 0)
         {
-            throw utils::wruntime_error(_T("usage:  SimPend config.cfg\n\nplease provide a config file."));
+            throw utils::wruntime_error(_T("usage:  SimPend config.cfg\n        SimPend directory | list.jobs\n\nplease provide a config file, a directory of config files or a job list."));
         }
 
         sFile = su::unquote(sFile);
+
+        // Batch job queue: run all configurations headless and quit
+        if (JobQueue::IsJobList(sFile))
+        {
+            JobQueue queue;
+            DWORD dwAttr(GetFileAttributes(sFile.c_str()));
+            if (dwAttr & FILE_ATTRIBUTE_DIRECTORY)
+                queue.AddDirectory(sFile);
+            else
+                queue.AddList(sFile);
+
+            queue.Run(-1);
+            return FALSE;
+        }
+
         m_Config.Load(sFile, au::IniFile::eIGNORE_CASE);
 
         // Create the OpenGL window
@@ -66,12 +82,13 @@ BOOL CSimApp::InitInstance()
 
         // initialize thread and simulation
         int w(0), h(0), cols(0), rows(0);
-        double  fw(0), fh(0);
+        double  fx(0), fy(0), fw(0), fh(0);
         m_pThread.reset(new SimThread(m_pWnd.get(), m_Config));
         m_pThread->GetSim()->QueryWinDim(w, h);
         m_pThread->GetSim()->QuerySimGrid(cols, rows);
-        m_pThread->GetSim()->QuerySimDim(fw, fh);
+        m_pThread->GetSim()->QueryViewport(fx, fy, fw, fh);
         CRect rect(0, 0, w, h);
+        m_pWnd->SetViewport(fx, fy, fw, fh);
         m_pWnd->Create(rect, cols, rows, fw, fh);
 
         // I need to resize the window because the border size is not accounted for in rect
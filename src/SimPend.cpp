@@ -5,6 +5,7 @@
 #include <sstream>
 #include <limits>
 #include <fstream>
+#include <algorithm>
 
 //--- Microsofts ----------------------------------------------------------------------------
 #include <atlimage.h>
@@ -44,26 +45,81 @@ SimImpl::SimImpl(CWndOpenGL* pWnd, const au::IniFile& iniFile)
 	, m_nWinWidth(0)
 	, m_nWinHeight(0)
 	, m_nThreads(0)
+	, m_eAffinity(afNONE)
+	, m_nNodes(1)
+	, m_nAutotuneSamples(0)
+	, m_fMetricsInterval(0)
+	, m_nTraceEvents(0)
 	, m_nMinSteps(0)
 	, m_nMaxSteps(0)
 	, m_nBatchMode(0)
+	, m_nSubsteps(1)
+	, m_nPass(0)
+	, m_nPassSteps(0)
+	, m_nFirstPassSteps(0)
+	, m_fPassGrowth(4)
+	, m_nStragglerSteps(0)
+	, m_eIntegrator(inBEEMAN)
+	, m_ePrecision(prDOUBLE)
+	, m_nPrecisionCheck(0)
 	, m_fTimeStep(0)
+	, m_fMaxTimeStep(0)
+	, m_fTolerance(0)
+	, m_fSubstepDist(0)
 	, m_fAbortVel(0)
 	, m_fFriction(0)
 	, m_fSimWidth(0)
 	, m_fSimHeight(0)
+	, m_fViewX(0)
+	, m_fViewY(0)
+	, m_fViewWidth(0)
+	, m_fViewHeight(0)
 	, m_fHeight(0)
+	, m_fMultScale(1)
 	, m_fMaxTraceLen(0)
 	, m_fTraceLenBuf(0)
 	, m_vpSrc()
 	, m_IdxField()
 	, m_LenField()
+	, m_vLaneIdx()
+	, m_vLaneLen()
+	, m_bChannels(false)
+	, m_StepField()
+	, m_TermField()
+	, m_TimeField()
+	, m_EndXField()
+	, m_EndYField()
 	, m_bColorNormalize(true)
 	, m_LineMgr()
+	, m_bCostSchedule(false)
+	, m_nScheduleSamples(0)
+	, m_vLineCost()
+	, m_vCostKnown()
+	, m_Symmetry()
+	, m_fSymmetryTol(0)
+	, m_ForceField()
+	, m_fFieldExact(0)
+	, m_SourceTree()
+	, m_fTreeTheta(0)
+	, m_nTreeLeaf(0)
+	, m_pKernel()
+	, m_SweepLanes()
+	, m_Animation()
+	, m_SampleCache()
+	, m_TileCache()
+	, m_vTileLoaded()
+	, m_bTilesStored(false)
+	, m_pAnimConfig()
+	, m_eCpuLevel(CpuDispatch::lvGENERIC)
+	, m_eCpuDetected(CpuDispatch::lvGENERIC)
+	, m_bCpuLevelFixed(false)
+	, m_nFrame(0)
+	, m_nFrameWritten(-1)
+	, m_bFillPass(false)
+	, m_nSourceVersion(0)
 	, m_parser()
 {
-	assert(m_pWnd);
-
+	// Without a window the simulation runs headless (batch job queue)
 	auto version = m_parser.GetVersion();
 
 	// bin muParser variables
@@ -77,6 +133,8 @@ SimImpl::SimImpl(CWndOpenGL* pWnd, const au::IniFile& iniFile)
 SimImpl::~SimImpl()
 {
 	utils::clear_cont_of_ptr(m_vpSrc);
+	utils::clear_cont_of_ptr(m_vLaneIdx);
+	utils::clear_cont_of_ptr(m_vLaneLen);
 }
 
 //-------------------------------------------------------------------------------------------
@@ -89,40 +147,160 @@ void SimImpl::SetField(int cols, int rows)
 
 	// Mark as uncalculated
 	m_IdxField = -1;
+	ResizeLaneFields();
+	ResizeChannelFields();
 
 	// Indices of lines waiting for calculation
 	m_LineMgr.Reset(m_nRows);
+
+	// Integrator states of unresolved grid points
+	m_vPending.assign(m_nRows, std::vector<SPendState>());
+	m_vStraggler.clear();
+	m_vStragglerBusy.clear();
+	m_nPass = 0;
+	m_bFillPass = false;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns false if a grid point is the symmetric image of another grid point.
+
+  The result of such points is filled in once the grid point from the fundamental domain
+  is calculated. Grid points predicted from the previous animation frame are not
+  calculated in the first pass either.
+  */
+bool SimImpl::NeedsCalc(int x, int y) const
+{
+	// Predicted grid points of an animation frame are filled in by FillLine
+	return m_Symmetry.IsCanonical(x, y) && m_Animation.GetPrediction(x, y) < 0;
 }
 
 //-------------------------------------------------------------------------------------------
 /** \brief Query index of next line to calculate and check if a new backup is necessary. */
-int SimImpl::QueryNextLine(int& nLine)
+int SimImpl::QueryNextLine(int& nLine, int nNode)
 {
 	int nIdx(0);
-	nLine = m_LineMgr.GetNextLine(nIdx);
+	nLine = m_LineMgr.GetNextLine(nIdx, nNode);
 	return nIdx;
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Assign the lines to NUMA nodes in contiguous blocks of equal size.
+	\param nNodes Number of nodes, 1 if the memory placement is not managed.
+
+	Workers querying lines with their node prefer the lines of that node.
+	*/
+void SimImpl::SetNodeCount(int nNodes)
+{
+	m_nNodes = (nNodes > 1) ? nNodes : 1;
+
+	std::vector<int> vNode;
+	if (m_nNodes > 1)
+	{
+		vNode.resize(m_nRows);
+		for (int y = 0; y < m_nRows; ++y)
+			vNode[y] = (int)((long long)y * m_nNodes / m_nRows);
+	}
+
+	m_LineMgr.SetLineNodes(vNode);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Allocate new buffers for all result fields without touching their memory.
+
+	The fields are initialized by the UI thread, so their pages are on its node. Moving the
+	lines of each node with a thread running on that node places them in local memory.
+	*/
+void SimImpl::BeginFieldPlacement()
+{
+	ForEachField([](auto& field) { field.BeginMove(); });
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Copy the lines of a node to the new buffers, must be called on that node. */
+void SimImpl::PlaceFieldLines(int nNode)
+{
+	// Lines y with y * m_nNodes / m_nRows == nNode, the last node takes the rest of the field
+	const std::size_t y0(((std::size_t)nNode * m_nRows + m_nNodes - 1) / m_nNodes),
+		y1((nNode == m_nNodes - 1) ? (std::size_t)-1 : ((std::size_t)(nNode + 1) * m_nRows + m_nNodes - 1) / m_nNodes);
+
+	ForEachField([y0, y1](auto& field) { field.MoveRows(y0, y1); });
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Release the old buffers, all nodes must have placed their lines. */
+void SimImpl::EndFieldPlacement()
+{
+	ForEachField([](auto& field) { field.EndMove(); });
+}
+
 //-------------------------------------------------------------------------------------------
 /** \brief Convert Window coordinates to physical coordinates. */
 void SimImpl::WinCoordToModel(int x, int y, double& sim_x, double& sim_y) const
 {
-	sim_x = (double)x / (double)m_nWinWidth * m_fSimWidth;
-	sim_y = (double)y / (double)m_nWinHeight * m_fSimHeight;
+	sim_x = m_fViewX + (double)x / (double)m_nWinWidth * m_fViewWidth;
+	sim_y = m_fViewY + (double)y / (double)m_nWinHeight * m_fViewHeight;
 }
 
 //-------------------------------------------------------------------------------------------
 void SimImpl::GridCoordToModel(int x, int y, double& sim_x, double& sim_y) const
 {
-	sim_x = (double)x / (double)m_nCols * m_fSimWidth;
-	sim_y = (double)y / (double)m_nRows * m_fSimHeight;
+	sim_x = m_fViewX + (double)x / (double)m_nCols * m_fViewWidth;
+	sim_y = m_fViewY + (double)y / (double)m_nRows * m_fViewHeight;
 }
 
 //-------------------------------------------------------------------------------------------
 void SimImpl::ModelCoordToWin(double sim_x, double sim_y, int& x, int& y) const
 {
-	x = mu::round((double)sim_x / (double)m_fSimWidth * m_nCols);
-	y = mu::round((double)sim_y / (double)m_fSimHeight * m_nRows);
+	x = mu::round((sim_x - m_fViewX) / m_fViewWidth * m_nCols);
+	y = mu::round((sim_y - m_fViewY) / m_fViewHeight * m_nRows);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Query the part of the simulation field covered by the grid. */
+void SimImpl::QueryViewport(double& x0, double& y0, double& width, double& height) const
+{
+	x0 = m_fViewX;
+	y0 = m_fViewY;
+	width = m_fViewWidth;
+	height = m_fViewHeight;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Move the grid to another part of the simulation field and restart the calculation.
+
+	The worker threads must be stopped. Symmetries are no longer used since they refer to
+	the full simulation field.
+	*/
+void SimImpl::SetViewport(double x0, double y0, double width, double height)
+{
+	if (width <= 0 || height <= 0)
+		throw utils::wruntime_error(_T("Viewport width and height must be greater then zero."));
+
+	m_fViewX = x0;
+	m_fViewY = y0;
+	m_fViewWidth = width;
+	m_fViewHeight = height;
+
+	m_Symmetry.Reset();
+	m_fSymmetryTol = 0;
+	m_Animation.ClearPrediction();
+	m_nPassSteps = m_nFirstPassSteps;
+	m_fMaxTraceLen = 0;
+	SetField(m_nCols, m_nRows);
+
+	// Lines of the new viewport may already be in the tile cache
+	m_vTileLoaded.assign(m_nRows, false);
+	m_bTilesStored = false;
+	if (m_TileCache.IsCreated())
+		RestoreTiles();
+
+	EstimateLineCost();
+}
+
+//-------------------------------------------------------------------------------------------
+bool SimImpl::IsFullViewport() const
+{
+	return m_fViewX == 0 && m_fViewY == 0 && m_fViewWidth == m_fSimWidth && m_fViewHeight == m_fSimHeight;
 }
 
 //-------------------------------------------------------------------------------------------
@@ -133,12 +311,91 @@ void SimImpl::ModelCoordToWin(double sim_x, double sim_y, int& x, int& y) const
 void SimImpl::FlagAsDone(int hLine)
 {
 	m_LineMgr.FlagAsCalculated(hLine);
+	CheckPassDone();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Refine the cost estimates with the integration steps a finished line took.
+
+	The lines between the neighbouring lines of known cost are interpolated again and the
+	waiting lines are sorted again. Only lines of the first pass are taken into account.
+	*/
+void SimImpl::ReportLineCost(int y, double fSteps)
+{
+	if (!m_bCostSchedule || IsResumePass() || y < 0 || y >= (int)m_vLineCost.size())
+		return;
+
+	m_vLineCost[y] = fSteps;
+	m_vCostKnown[y] = true;
+
+	int y0(y - 1), y1(y + 1);
+	while (y0 >= 0 && !m_vCostKnown[y0])
+		--y0;
+
+	while (y1 < m_nRows && !m_vCostKnown[y1])
+		++y1;
+
+	InterpolateLineCost(y0, y);
+	InterpolateLineCost(y, y1);
+	m_LineMgr.SortByCost(m_vLineCost);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Queue the unresolved grid points once all lines and stragglers of a pass are done. */
+void SimImpl::CheckPassDone()
+{
+	au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+	if (m_LineMgr.IsDone() && m_vStraggler.empty() && m_vStragglerBusy.empty())
+		StartNextPass();
 }
 
 //-------------------------------------------------------------------------------------------
 bool SimImpl::IsDone() const
 {
-	return m_LineMgr.IsDone();
+	au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+	return m_LineMgr.IsDone() && m_vStraggler.empty() && m_vStragglerBusy.empty();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Lines with grid points that are not resolved yet.
+
+	These are the waiting lines and the lines of the pending grid points and the stragglers.
+	Returns no lines if all grid points are resolved or were never deferred, the lines
+	waiting for the first pass are known by the line manager.
+	*/
+void SimImpl::QueryUnresolvedLines(std::vector<int>& vLines) const
+{
+	vLines.clear();
+
+	au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+	std::vector<bool> vUnresolved(m_nRows, false);
+	bool bDeferred(m_nPass > 0);
+	for (int y = 0; y < (int)m_vPending.size(); ++y)
+	{
+		if (m_vPending[y].size())
+			vUnresolved[y] = bDeferred = true;
+	}
+
+	for (std::size_t i = 0; i < m_vStraggler.size(); ++i)
+		vUnresolved[m_vStraggler[i].y] = bDeferred = true;
+
+	for (std::size_t i = 0; i < m_vStragglerBusy.size(); ++i)
+		vUnresolved[m_vStragglerBusy[i]] = bDeferred = true;
+
+	if (!bDeferred)
+		return;
+
+	// Lines in progress are still waiting
+	std::vector<int> vWaiting;
+	m_LineMgr.QueryWaitingLines(vWaiting);
+	for (std::size_t i = 0; i < vWaiting.size(); ++i)
+		vUnresolved[vWaiting[i]] = true;
+
+	for (int y = 0; y < m_nRows; ++y)
+	{
+		if (vUnresolved[y])
+			vLines.push_back(y);
+	}
 }
 
 //-------------------------------------------------------------------------------------------
@@ -164,15 +421,128 @@ void SimImpl::InitFromFile(const au::IniFile& iniFile)
 	m_fSimWidth = iniFile.GetAsFloatFromExpr(_T("FIELD"), _T("SIM_WIDTH"), (double)cols);
 	m_fSimHeight = iniFile.GetAsFloatFromExpr(_T("FIELD"), _T("SIM_HEIGHT"), (double)rows);
 
+	// Part of the simulation field covered by the grid, given as x0, y0, width, height
+	m_fViewX = 0;
+	m_fViewY = 0;
+	m_fViewWidth = m_fSimWidth;
+	m_fViewHeight = m_fSimHeight;
+	if (iniFile.HasKey(_T("FIELD"), _T("VIEWPORT")))
+	{
+		std::wstring sView(iniFile.GetAsString(_T("FIELD"), _T("VIEWPORT")));
+		if (swscanf(sView.c_str(), _T("%lf,%lf,%lf,%lf"), &m_fViewX, &m_fViewY, &m_fViewWidth, &m_fViewHeight) != 4)
+			throw utils::wruntime_error(_T("Invalid viewport format (x0,y0,width,height is expected)."));
+
+		if (m_fViewWidth <= 0 || m_fViewHeight <= 0)
+			throw utils::wruntime_error(_T("Viewport width and height must be greater then zero."));
+	}
+
 	// other parameters
 	m_nBatchMode = iniFile.GetAsInt(_T("SIMULATION"), _T("BATCH_MODE"), 0);
 	m_nThreads = iniFile.GetAsInt(_T("SIMULATION"), _T("THREADS"), -1);
+
+	// Pinning of the worker threads, NODE and CORE also place the lines in local memory
+	m_eAffinity = afNONE;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("THREAD_AFFINITY")))
+	{
+		std::wstring sAffinity(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("THREAD_AFFINITY")))));
+		if (sAffinity == _T("NODE"))
+			m_eAffinity = afNODE;
+		else if (sAffinity == _T("CORE"))
+			m_eAffinity = afCORE;
+		else if (sAffinity != _T("NONE"))
+			throw utils::wruntime_error(_T("Invalid thread affinity (valid values are \"NONE\", \"NODE\" or \"CORE\")."));
+	}
+
+	// Calibrate the thread count and the instruction set unless they are given
+	m_nAutotuneSamples = 0;
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("AUTOTUNE"), 0))
+	{
+		m_nAutotuneSamples = iniFile.GetAsInt(_T("SIMULATION"), _T("AUTOTUNE_SAMPLES"), 2000);
+		if (m_nAutotuneSamples <= 0)
+			throw utils::wruntime_error(_T("Number of autotune samples must be greater then zero."));
+	}
+
+	m_fMetricsInterval = iniFile.GetAsFloat(_T("SIMULATION"), _T("METRICS_INTERVAL"), 0);
+	if (m_fMetricsInterval < 0)
+		throw utils::wruntime_error(_T("Metrics interval must not be negative."));
+
+	m_nTraceEvents = iniFile.GetAsInt(_T("SIMULATION"), _T("TRACE_EVENTS"), 0);
+	if (m_nTraceEvents < 0)
+		throw utils::wruntime_error(_T("Number of trace events must not be negative."));
+
+	// Order in which the lines are handed out to the threads
+	m_bCostSchedule = false;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("SCHEDULE")))
+	{
+		std::wstring sSchedule(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("SCHEDULE")))));
+		if (sSchedule == _T("COST"))
+			m_bCostSchedule = true;
+		else if (sSchedule != _T("INDEX"))
+			throw utils::wruntime_error(_T("Invalid schedule (valid values are \"INDEX\" or \"COST\")."));
+	}
+
+	m_nScheduleSamples = iniFile.GetAsInt(_T("SIMULATION"), _T("SCHEDULE_SAMPLES"), 1024);
+	if (m_nScheduleSamples <= 0)
+		throw utils::wruntime_error(_T("Number of schedule samples must be greater then zero."));
+
 	m_nMaxSteps = iniFile.GetAsInt(_T("SIMULATION"), _T("MAX_STEPS"));
 	m_nMinSteps = iniFile.GetAsInt(_T("SIMULATION"), _T("MIN_STEPS"));
 	m_fHeight = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("PEND_HEIGHT"));
 	m_fAbortVel = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("ABORT_VEL"));
 	m_fTimeStep = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("DELTA_T"));
 
+	// Integration scheme, DOPRI5 uses an adaptive step size starting from DELTA_T
+	m_eIntegrator = inBEEMAN;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("INTEGRATOR")))
+	{
+		std::wstring sIntegrator(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("INTEGRATOR")))));
+		if (sIntegrator == _T("DOPRI5"))
+			m_eIntegrator = inDOPRI5;
+		else if (sIntegrator != _T("BEEMAN"))
+			throw utils::wruntime_error(_T("Invalid integrator (valid values are \"BEEMAN\" or \"DOPRI5\")."));
+	}
+
+	// Floating point precision of the integration
+	m_ePrecision = prDOUBLE;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("PRECISION")))
+	{
+		std::wstring sPrecision(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("PRECISION")))));
+		if (sPrecision == _T("FLOAT"))
+			m_ePrecision = prFLOAT;
+		else if (sPrecision != _T("DOUBLE"))
+			throw utils::wruntime_error(_T("Invalid precision (valid values are \"DOUBLE\" or \"FLOAT\")."));
+
+		if (m_ePrecision == prFLOAT && m_eIntegrator != inBEEMAN)
+			throw utils::wruntime_error(_T("Single precision is only supported by the BEEMAN integrator."));
+	}
+
+	m_nPrecisionCheck = iniFile.GetAsInt(_T("SIMULATION"), _T("PRECISION_CHECK"), 0);
+
+	m_fTolerance = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("INTEGRATOR_TOL"), 1e-6);
+	m_fMaxTimeStep = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("INTEGRATOR_DT_MAX"), 10 * m_fTimeStep);
+	if (m_fTolerance <= 0)
+		throw utils::wruntime_error(_T("Integrator tolerance must be greater then zero."));
+
+	// Sub stepping of the fixed step integrator close to the sources, the distance is
+	// given in multiples of the larger one of the source SIZE and PEND_HEIGHT.
+	m_fSubstepDist = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("SUBSTEP_DIST"), 0);
+	m_nSubsteps = iniFile.GetAsInt(_T("SIMULATION"), _T("SUBSTEP_NUM"), 4);
+	if (m_nSubsteps <= 0)
+		throw utils::wruntime_error(_T("Number of sub steps must be greater then zero."));
+
+	// Two pass mode, the first pass stops after PASS_STEPS steps and later passes resume
+	// the unresolved grid points with a step limit growing by PASS_GROWTH.
+	int nPassSteps = iniFile.GetAsInt(_T("SIMULATION"), _T("PASS_STEPS"), 0);
+	m_nPassSteps = (nPassSteps > 0) ? std::min(nPassSteps, m_nMaxSteps) : m_nMaxSteps;
+	m_nFirstPassSteps = m_nPassSteps;
+	m_fPassGrowth = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("PASS_GROWTH"), 4);
+	if (m_fPassGrowth <= 1)
+		throw utils::wruntime_error(_T("Pass growth factor must be greater then one."));
+
+	// Soft step budget per grid point, slower grid points are deferred to the straggler
+	// queue which is processed by all threads once the regular work is done.
+	m_nStragglerSteps = iniFile.GetAsInt(_T("SIMULATION"), _T("STRAGGLER_STEPS"), 0);
+
 	std::wstring sExpr(iniFile.GetAsString(_T("SIMULATION"), _T("COLOR_SCHEME")));
 	if (!sExpr.length())
 	{
@@ -190,8 +560,211 @@ void SimImpl::InitFromFile(const au::IniFile& iniFile)
 		throw utils::wruntime_error(_T("Friction parameter must be greater then zero."));
 	}
 
+	// Parameter sweep, up to SweepLanes::MAX_LANES values of FRICTION, PEND_HEIGHT or a
+	// factor on the MULT of the decaying sources are integrated in lockstep. Each value
+	// produces a result field, the first one replaces the configured value and is the one
+	// shown in the preview window.
+	SweepLanes::EParam eSweepParam(SweepLanes::spFRICTION);
+	std::vector<double> vSweepValues;
+	m_fMultScale = 1;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("SWEEP_PARAM")))
+	{
+		eSweepParam = SweepLanes::FromName(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("SWEEP_PARAM")))));
+
+		su::StringTokens<std::wstring> tok(iniFile.GetAsString(_T("SIMULATION"), _T("SWEEP_VALUES")), _T(","));
+		for (unsigned i = 0; i < tok.Count(); ++i)
+		{
+			double fVal(0);
+			if (swscanf(su::trim(tok[i]).c_str(), _T("%lf"), &fVal) != 1)
+				throw utils::wruntime_error(_T("Invalid sweep value format (a comma separated list of numbers is expected)."));
+
+			vSweepValues.push_back(fVal);
+		}
+
+		if (vSweepValues.empty())
+			throw utils::wruntime_error(_T("No values for the parameter sweep given."));
+
+		if (m_eIntegrator != inBEEMAN || m_ePrecision != prDOUBLE)
+			throw utils::wruntime_error(_T("Parameter sweeps require the BEEMAN integrator in double precision."));
+
+		if (m_nPassSteps < m_nMaxSteps || m_nStragglerSteps > 0)
+			throw utils::wruntime_error(_T("Parameter sweeps do not support PASS_STEPS or STRAGGLER_STEPS."));
+
+		switch (eSweepParam)
+		{
+		case SweepLanes::spFRICTION:    m_fFriction = vSweepValues[0]; break;
+		case SweepLanes::spPEND_HEIGHT: m_fHeight = vSweepValues[0]; break;
+		case SweepLanes::spMULT:        m_fMultScale = vSweepValues[0]; break;
+		}
+	}
+
+
+	// Animation, the sources are read again for every frame using their keyframed
+	// parameters. Every frame after the first one is predicted from its predecessor,
+	// ANIM_BLOCK is the cell size of the prediction.
+	m_Animation.Reset();
+	m_pAnimConfig.reset();
+	m_nFrame = 0;
+	m_nFrameWritten = -1;
+	int nFrames = iniFile.GetAsInt(_T("SIMULATION"), _T("ANIM_FRAMES"), 0);
+	if (nFrames > 0)
+	{
+		if (vSweepValues.size())
+			throw utils::wruntime_error(_T("Animations do not support parameter sweeps."));
+
+		if (m_nPassSteps < m_nMaxSteps)
+			throw utils::wruntime_error(_T("Animations do not support PASS_STEPS."));
+
+		// The symmetries and the precomputed source data would change from frame to frame
+		if (iniFile.GetAsInt(_T("SIMULATION"), _T("SYMMETRY"), 0) ||
+			iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_FIELD"), 0) ||
+			iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_TREE"), 0))
+			throw utils::wruntime_error(_T("Animations do not support SYMMETRY, FORCE_FIELD or FORCE_TREE."));
+
+		m_Animation.Create(iniFile, nFrames, iniFile.GetAsInt(_T("SIMULATION"), _T("ANIM_BLOCK"), 4));
+		m_pAnimConfig.reset(new au::IniFile(iniFile));
+		TRACE(_T("Animation: %s\n"), m_Animation.GetDescription().c_str());
+	}
 
 	// set up magnet positions and strengthes
+	ReadSources(iniFile, 0);
+
+	m_SweepLanes.Reset();
+	if (vSweepValues.size())
+	{
+		m_SweepLanes.Create(m_vpSrc, eSweepParam, vSweepValues, m_fFriction, m_fHeight);
+		TRACE(_T("Parameter sweep: %s\n"), m_SweepLanes.GetDescription().c_str());
+	}
+
+	ResizeLaneFields();
+
+	// Detect symmetries of the source layout, if there are any only the fundamental 
+	// domain will be calculated. Symmetries are only used if the grid covers the full field.
+	m_Symmetry.Reset();
+	m_fSymmetryTol = 0;
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("SYMMETRY"), 0) && IsFullViewport())
+	{
+		double fTol = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("SYMMETRY_TOL"), 1e-6);
+		m_Symmetry.Detect(m_vpSrc, m_fSimWidth, m_fSimHeight, m_nCols, m_nRows, fTol);
+		m_fSymmetryTol = fTol;
+		TRACE(_T("Symmetries detected: %s\n"), m_Symmetry.GetDescription().c_str());
+	}
+
+	// Optional precomputed force field, makes the step cost independent of the number
+	// of sources.
+	m_fFieldExact = 0;
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_FIELD"), 0))
+	{
+		int nRes = iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_FIELD_RES"), 512);
+		double fExact = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("FORCE_FIELD_EXACT"), 4);
+		if (nRes <= 0)
+			throw utils::wruntime_error(_T("Force field resolution must be greater then zero."));
+
+		// Below one the capture radius of the sources is interpolated and captures are missed
+		if (fExact < 1)
+			throw utils::wruntime_error(_T("Exact force field distance must not be less then one."));
+
+		if (m_SweepLanes.IsCreated())
+			throw utils::wruntime_error(_T("Parameter sweeps do not support FORCE_FIELD."));
+
+		m_ForceField.Create(m_vpSrc, m_fSimWidth, m_fSimHeight, m_fHeight, nRes, fExact);
+		m_fFieldExact = fExact;
+	}
+
+	// Optional Barnes-Hut evaluation for large source arrays
+	m_fTreeTheta = 0;
+	m_nTreeLeaf = 0;
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_TREE"), 0))
+	{
+		double fTheta = iniFile.GetAsFloatFromExpr(_T("SIMULATION"), _T("FORCE_TREE_THETA"), 0.5);
+		int nLeafSize = iniFile.GetAsInt(_T("SIMULATION"), _T("FORCE_TREE_LEAF"), 8);
+		if (fTheta < 0)
+			throw utils::wruntime_error(_T("Opening angle of the force tree must not be negative."));
+
+		if (m_SweepLanes.IsCreated())
+			throw utils::wruntime_error(_T("Parameter sweeps do not support FORCE_TREE."));
+
+		m_SourceTree.Create(m_vpSrc, m_fHeight, fTheta, nLeafSize);
+		m_fTreeTheta = fTheta;
+		m_nTreeLeaf = nLeafSize;
+	}
+
+	// Kernel specialized on the source layout, the generic evaluation is used if there
+	// is no specialization.
+	// The instruction set of the kernel is detected at runtime, CPU_DISPATCH can only lower it.
+	const CpuDispatch::ELevel eDetected(CpuDispatch::Detect());
+	CpuDispatch::ELevel eLevel(eDetected);
+	m_bCpuLevelFixed = false;
+	if (iniFile.HasKey(_T("SIMULATION"), _T("CPU_DISPATCH")))
+	{
+		std::wstring sDispatch(su::trim(su::to_upper(iniFile.GetAsString(_T("SIMULATION"), _T("CPU_DISPATCH")))));
+		if (sDispatch != _T("AUTO"))
+		{
+			m_bCpuLevelFixed = true;
+			eLevel = CpuDispatch::FromName(sDispatch);
+			if (eLevel > eDetected)
+				throw utils::wruntime_error(_T("The requested cpu dispatch level is not supported by this cpu."));
+		}
+	}
+
+	TRACE(_T("CPU dispatch: %s (detected %s)\n"), CpuDispatch::GetName(eLevel), CpuDispatch::GetName(eDetected));
+
+	m_eCpuLevel = eLevel;
+	m_eCpuDetected = eDetected;
+	m_pKernel.reset();
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("SPECIALIZED_KERNEL"), 1))
+		m_pKernel.reset(ISourceKernel::Create(m_vpSrc, m_fHeight, eLevel));
+
+	TRACE(_T("Source kernel: %s\n"), GetKernelName().c_str());
+
+	// Persistent cache of calculated grid points, renders of overlapping viewports and
+	// renders at a different resolution reuse the grid points with the same start position.
+	m_SampleCache.Reset();
+	if (iniFile.GetAsInt(_T("SIMULATION"), _T("SAMPLE_CACHE"), 0))
+	{
+		if (m_SweepLanes.IsCreated() || m_Animation.IsCreated())
+			throw utils::wruntime_error(_T("The sample cache does not support parameter sweeps or animations."));
+
+		int nMaxSize = iniFile.GetAsInt(_T("SIMULATION"), _T("SAMPLE_CACHE_MAX"), 1 << 24);
+		if (nMaxSize <= 0)
+			throw utils::wruntime_error(_T("Sample cache size must be greater then zero."));
+
+		// The quantum is far below the grid spacing of any zoom level double precision can resolve
+		m_SampleCache.Create(std::max(m_fSimWidth, m_fSimHeight) * std::ldexp(1.0, -40), nMaxSize, GetConfigHash());
+	}
+
+	// On-disk cache of calculated lines, shared by all configurations using the directory
+	m_TileCache.Reset();
+	if (iniFile.HasKey(_T("SIMULATION"), _T("TILE_CACHE_DIR")))
+	{
+		std::wstring sDir(su::trim(iniFile.GetAsString(_T("SIMULATION"), _T("TILE_CACHE_DIR"))));
+		if (sDir.length())
+		{
+			if (m_SweepLanes.IsCreated() || m_Animation.IsCreated())
+				throw utils::wruntime_error(_T("The tile cache does not support parameter sweeps or animations."));
+
+			int nSize = iniFile.GetAsInt(_T("SIMULATION"), _T("TILE_CACHE_SIZE"), 1024);
+			if (nSize <= 0)
+				throw utils::wruntime_error(_T("Tile cache size must be greater then zero."));
+
+			m_TileCache.Create(sDir, (unsigned long long)nSize * 1024 * 1024);
+		}
+	}
+
+	// Extra output channels written with the checkpoint: step count, termination reason,
+	// simulated time until termination and the final position of each grid point
+	m_bChannels = iniFile.GetAsInt(_T("SIMULATION"), _T("EXTRA_CHANNELS"), 0) != 0;
+	if (m_bChannels && m_Animation.IsCreated())
+		throw utils::wruntime_error(_T("The extra channels do not support animations."));
+
+	ResizeChannelFields();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Create the sources of an animation frame, the first frame if there is no animation. */
+void SimImpl::ReadSources(const au::IniFile& iniFile, int nFrame)
+{
+	utils::clear_cont_of_ptr(m_vpSrc);
 	for (int i = 1;; ++i)
 	{
 		std::wstringstream ss;
@@ -200,12 +773,19 @@ void SimImpl::InitFromFile(const au::IniFile& iniFile)
 		if (!bStat) // Section does not exist
 			break;
 
-		m_vpSrc.push_back(ReadSourceData(ss.str(), iniFile));
+		m_vpSrc.push_back(ReadSourceData(ss.str(), iniFile, nFrame));
 	}
 }
 
 //-------------------------------------------------------------------------------------------
-ISource* SimImpl::ReadSourceData(const std::wstring& sSection, const au::IniFile& iniFile)
+/** \brief Read a numeric source parameter, keyframed parameters are interpolated. */
+double SimImpl::ReadSourceValue(const std::wstring& sSection, const wchar_t* szKey, const au::IniFile& iniFile, int nFrame) const
+{
+	return m_Animation.QueryValue(sSection, szKey, nFrame, iniFile.GetAsFloatFromExpr(sSection, szKey));
+}
+
+//-------------------------------------------------------------------------------------------
+ISource* SimImpl::ReadSourceData(const std::wstring& sSection, const au::IniFile& iniFile, int nFrame)
 {
 	using std::sin;
 	using std::cos;
@@ -221,22 +801,26 @@ ISource* SimImpl::ReadSourceData(const std::wstring& sSection, const au::IniFile
 		throw utils::wruntime_error(_T("Invalid color format (r,g,b is expected)."));
 
 	// 1.) Source strength and size 
-	mult = iniFile.GetAsFloatFromExpr(sSection, _T("MULT"));
-	size = iniFile.GetAsFloatFromExpr(sSection, _T("SIZE"));
+	mult = ReadSourceValue(sSection, _T("MULT"), iniFile, nFrame);
+	size = ReadSourceValue(sSection, _T("SIZE"), iniFile, nFrame);
 
 	// 2.) The source type
 	std::wstring sType(su::to_upper(iniFile.GetAsString(sSection, _T("TYPE"))));
 
+	// The first value of a MULT sweep scales all decaying sources
+	if (sType != _T("LINEAR"))
+		mult *= m_fMultScale;
+
 	// 3.) Position
 	if (iniFile.HasKey(sSection, _T("XPOS")) && iniFile.HasKey(sSection, _T("YPOS")))
 	{
-		pos[0] = iniFile.GetAsFloatFromExpr(sSection, _T("XPOS"));
-		pos[1] = iniFile.GetAsFloatFromExpr(sSection, _T("YPOS"));
+		pos[0] = ReadSourceValue(sSection, _T("XPOS"), iniFile, nFrame);
+		pos[1] = ReadSourceValue(sSection, _T("YPOS"), iniFile, nFrame);
 	}
 	else if (iniFile.HasKey(sSection, _T("RAD")) && iniFile.HasKey(sSection, _T("THETA")))
 	{
-		double rad = iniFile.GetAsFloatFromExpr(sSection, _T("RAD")),
-			theta = iniFile.GetAsFloatFromExpr(sSection, _T("THETA"));
+		double rad = ReadSourceValue(sSection, _T("RAD"), iniFile, nFrame),
+			theta = ReadSourceValue(sSection, _T("THETA"), iniFile, nFrame);
 		pos[0] = (int)(m_fSimWidth / 2.0 + (double)rad * std::cos((double)theta * mu::DEG2RAD));
 		pos[1] = (int)(m_fSimHeight / 2.0 + (double)rad * std::sin((double)theta * mu::DEG2RAD));
 	}
@@ -287,12 +871,133 @@ int SimImpl::GetThreadCount() const
 	return m_nThreads;
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Set the number of worker threads, -1 for one thread per processor. */
+void SimImpl::SetThreadCount(int nThreads)
+{
+	m_nThreads = nThreads;
+}
+
+//-------------------------------------------------------------------------------------------
+SimImpl::EAffinity SimImpl::GetAffinity() const
+{
+	return m_eAffinity;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Grid points integrated per autotune candidate, 0 if AUTOTUNE is not set. */
+int SimImpl::GetAutotuneSamples() const
+{
+	return m_nAutotuneSamples;
+}
+
+//-------------------------------------------------------------------------------------------
+CpuDispatch::ELevel SimImpl::GetCpuLevel() const
+{
+	return m_eCpuLevel;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Best instruction set of this cpu, the kernel may use a lower one. */
+CpuDispatch::ELevel SimImpl::GetDetectedCpuLevel() const
+{
+	return m_eCpuDetected;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Switch the source kernel to another instruction set.
+
+	The level must not be above the detected one. Must not be called while the workers
+	integrate, a running probe is dropped.
+	*/
+void SimImpl::SetCpuLevel(CpuDispatch::ELevel eLevel)
+{
+	au::AutoLock<CCriticalSection> lock(&m_SourceLock);
+	m_eCpuLevel = eLevel;
+	if (m_pKernel.get())
+		m_pKernel.reset(ISourceKernel::Create(m_vpSrc, m_fHeight, eLevel));
+
+	// Samples of the previous kernel are not valid for the new one
+	if (m_SampleCache.IsCreated())
+		m_SampleCache.SetConfigHash(GetConfigHash());
+
+	++m_nSourceVersion;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief True if the instruction set is given by CPU_DISPATCH. */
+bool SimImpl::IsCpuLevelFixed() const
+{
+	return m_bCpuLevelFixed;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief True if the integration uses the specialized source kernel, only the kernel
+	depends on the instruction set.
+	*/
+bool SimImpl::UsesCpuDispatch() const
+{
+	return m_pKernel.get() && !m_ForceField.GetRes() && !m_SourceTree.IsCreated();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Seconds between two samples of the runtime metrics, 0 if no metrics are shown. */
+double SimImpl::GetMetricsInterval() const
+{
+	return m_fMetricsInterval;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Number of timeline events recorded per thread, 0 if no trace is recorded. */
+int SimImpl::GetTraceEvents() const
+{
+	return m_nTraceEvents;
+}
+
 //-------------------------------------------------------------------------------------------
 std::size_t SimImpl::GetSrcCount() const
 {
 	return m_vpSrc.size();
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Rough estimate of the calculation cost used to order batch jobs.
+
+	Grid points filled in by symmetry are not counted, every grid point is assumed to
+	need MAX_STEPS steps for each source.
+	*/
+double SimImpl::EstimateCost() const
+{
+	double fPoints(0);
+	for (int y = 0; y < m_nRows; ++y)
+	{
+		for (int x = 0; x < m_nCols; ++x)
+		{
+			if (NeedsCalc(x, y))
+				fPoints += 1;
+		}
+	}
+
+	return fPoints * m_nMaxSteps * std::max<std::size_t>(m_vpSrc.size(), 1) * std::max(m_SweepLanes.GetLanes(), 1) *
+		std::max(m_Animation.GetFrames(), 1);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Name of the source evaluation used for the integration. */
+std::wstring SimImpl::GetKernelName() const
+{
+	if (m_ForceField.GetRes())
+		return _T("force field");
+
+	if (m_SourceTree.IsCreated())
+		return _T("source tree");
+
+	if (!m_pKernel.get())
+		return _T("generic");
+
+	return m_pKernel->GetName() + _T(" (") + CpuDispatch::GetName(m_eCpuLevel) + _T(")");
+}
+
 //-------------------------------------------------------------------------------------------
 const ISource* SimImpl::GetMagnet(std::size_t idx) const
 {
@@ -303,6 +1008,23 @@ const ISource* SimImpl::GetMagnet(std::size_t idx) const
 //-------------------------------------------------------------------------------------------
 void SimImpl::CreateBitmap(const std::wstring& sFile)
 {
+	CreateBitmap(sFile, m_IdxField, m_LenField);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Write a result field to a bitmap file.
+
+	The color scheme is evaluated with a parser of its own, the trace lengths are
+	normalized to the maximum of the given field.
+	*/
+void SimImpl::CreateBitmap(const std::wstring& sFile, const int_field_type& idxField, const float_field_type& lenField) const
+{
+	double len(0), max_len(lenField.Max());
+	mu::Parser parser;
+	parser.DefineVar(_T("len"), &len);
+	parser.DefineVar(_T("max_len"), &max_len);
+	parser.SetExpr(m_parser.GetExpr());
+
 	unsigned* rgbData(new unsigned[m_nCols * m_nRows]);
 	memset(rgbData, 0, m_nRows * m_nCols * sizeof(unsigned));
 
@@ -310,7 +1032,7 @@ void SimImpl::CreateBitmap(const std::wstring& sFile)
 	{
 		for (int y = 0; y < m_nRows; ++y)
 		{
-			int nIdx(m_IdxField[y][x]);
+			int nIdx(idxField[y][x]);
 			if (nIdx < 0)
 				continue;
 
@@ -318,8 +1040,8 @@ void SimImpl::CreateBitmap(const std::wstring& sFile)
 			const ISource* pSrc(m_vpSrc[nIdx]);
 
 			// calculate the scalig
-			m_fTraceLenBuf = m_LenField[y][x];
-			double scale(m_parser.Eval());
+			len = lenField[y][x];
+			double scale(parser.Eval());
 			rgbData[y * m_nCols + x] = RGB(scale * pSrc->GetBlue(),
 				scale * pSrc->GetGreen(),
 				scale * pSrc->GetRed());
@@ -344,6 +1066,8 @@ void SimImpl::CreateBitmap(const std::wstring& sFile)
   */
 void SimImpl::DumpToFile(const std::wstring& sPath, const std::wstring& sFile)
 {
+	TraceRecorder::Scope trace(_T("checkpoint"));
+
 	std::wstring sOutDir(sPath + sFile + _T(".restore"));
 	std::wstring sImgFile(sPath.length() ? sPath + _T("\\") + sFile + _T(".bmp") :
 		sFile + _T(".bmp"));
@@ -353,16 +1077,80 @@ void SimImpl::DumpToFile(const std::wstring& sPath, const std::wstring& sFile)
 
 	m_IdxField.Write(sOutDir + _T("\\") + sFile + _T(".idx"));
 	m_LenField.Write(sOutDir + _T("\\") + sFile + _T(".len"));
-	m_LineMgr.SaveState(sOutDir + _T("\\") + sFile + _T(".pos"));
-}
+	// The integrator states of unresolved grid points are not stored, their lines are
+	// calculated again from the first pass after a restore
+	std::vector<int> vUnresolved;
+	QueryUnresolvedLines(vUnresolved);
+	if (vUnresolved.size())
+	{
+		TaskMgr redo;
+		redo.Reset(vUnresolved);
+		redo.SaveState(sOutDir + _T("\\") + sFile + _T(".pos"));
+	}
+	else
+		m_LineMgr.SaveState(sOutDir + _T("\\") + sFile + _T(".pos"));
 
+	if (m_bChannels)
+	{
+		m_StepField.Write(sOutDir + _T("\\") + sFile + _T(".steps"));
+		m_TermField.Write(sOutDir + _T("\\") + sFile + _T(".term"));
+		m_TimeField.Write(sOutDir + _T("\\") + sFile + _T(".time"));
+		m_EndXField.Write(sOutDir + _T("\\") + sFile + _T(".endx"));
+		m_EndYField.Write(sOutDir + _T("\\") + sFile + _T(".endy"));
+	}
 
-//-------------------------------------------------------------------------------------------
-/** \brief Restore a calculation from file.
-	\param sName Name of the data file.
-	*/
-void SimImpl::Restore(const std::wstring& sPath, const std::wstring& sName)
+	// The checkpoint is only valid for the viewport it was calculated for
+	std::wstring sViewFile(sOutDir + _T("\\") + sFile + _T(".view"));
+	std::wofstream ofs(sViewFile.c_str());
+	ofs.precision(17);
+	ofs << m_fViewX << _T(" ") << m_fViewY << _T(" ") << m_fViewWidth << _T(" ") << m_fViewHeight << std::endl;
+	ofs.close();
+
+	if (m_SampleCache.IsCreated())
+	{
+		m_SampleCache.Save(sOutDir + _T("\\") + sFile + _T(".samples"));
+		TRACE(_T("Sample cache: %d samples, %d hits\n"), (int)m_SampleCache.GetSize(), (int)m_SampleCache.GetHits());
+	}
+
+	if (m_TileCache.IsCreated() && !m_bTilesStored && IsDone())
+		StoreTiles(sPath, sFile);
+
+	// Additional lanes of a parameter sweep, lane 0 is stored above
+	for (std::size_t i = 0; i < m_vLaneIdx.size(); ++i)
+	{
+		std::wstring sLane(_T(".lane") + std::to_wstring(i + 1));
+		std::wstring sLaneImg(sPath.length() ? sPath + _T("\\") + sFile + sLane + _T(".bmp") :
+			sFile + sLane + _T(".bmp"));
+
+		CreateBitmap(sLaneImg, *m_vLaneIdx[i], *m_vLaneLen[i]);
+		m_vLaneIdx[i]->Write(sOutDir + _T("\\") + sFile + sLane + _T(".idx"));
+		m_vLaneLen[i]->Write(sOutDir + _T("\\") + sFile + sLane + _T(".len"));
+	}
+}
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Restore a calculation from file.
+	\param sName Name of the data file.
+	*/
+void SimImpl::Restore(const std::wstring& sPath, const std::wstring& sName)
 {
+	TraceRecorder::Scope trace(_T("restore"));
+
+	bool bRestored(false);
+	m_vTileLoaded.assign(m_nRows, false);
+	m_bTilesStored = false;
+
+	if (m_SampleCache.IsCreated())
+		m_SampleCache.Load(sPath + sName + _T(".restore\\") + sName + _T(".samples"));
+
+	// The checkpoint does not know about animation frames, animations start from scratch
+	if (m_Animation.IsCreated())
+	{
+		DrawModel();
+		return;
+	}
+
 	try
 	{
 		std::wstring sRetoreDir(sPath + sName + _T(".restore"));
@@ -370,18 +1158,53 @@ void SimImpl::Restore(const std::wstring& sPath, const std::wstring& sName)
 		// Reset data buffer
 		m_IdxField.Nullify();
 		m_LenField.Nullify();
+		for (std::size_t i = 0; i < m_vLaneIdx.size(); ++i)
+		{
+			m_vLaneIdx[i]->Nullify();
+			m_vLaneLen[i]->Nullify();
+		}
+		ResizeChannelFields();
 
 		// Read data buffer
 		m_IdxField.Read(sRetoreDir + _T("\\") + sName + _T(".idx"));
 		m_LenField.Read(sRetoreDir + _T("\\") + sName + _T(".len"));
 		m_fMaxTraceLen = m_LenField.Max();
 
+		for (std::size_t i = 0; i < m_vLaneIdx.size(); ++i)
+		{
+			std::wstring sLane(_T(".lane") + std::to_wstring(i + 1));
+			m_vLaneIdx[i]->Read(sRetoreDir + _T("\\") + sName + sLane + _T(".idx"));
+			m_vLaneLen[i]->Read(sRetoreDir + _T("\\") + sName + sLane + _T(".len"));
+		}
+
+		if (m_bChannels)
+		{
+			m_StepField.Read(sRetoreDir + _T("\\") + sName + _T(".steps"));
+			m_TermField.Read(sRetoreDir + _T("\\") + sName + _T(".term"));
+			m_TimeField.Read(sRetoreDir + _T("\\") + sName + _T(".time"));
+			m_EndXField.Read(sRetoreDir + _T("\\") + sName + _T(".endx"));
+			m_EndYField.Read(sRetoreDir + _T("\\") + sName + _T(".endy"));
+		}
+
+		// A checkpoint of another viewport is discarded, checkpoints without a viewport
+		// are from the full simulation field
+		double fView[4] = { 0, 0, m_fSimWidth, m_fSimHeight };
+		std::wstring sViewFile(sRetoreDir + _T("\\") + sName + _T(".view"));
+		std::wifstream ifs(sViewFile.c_str());
+		if (ifs)
+			ifs >> fView[0] >> fView[1] >> fView[2] >> fView[3];
+
+		if (fView[0] != m_fViewX || fView[1] != m_fViewY || fView[2] != m_fViewWidth || fView[3] != m_fViewHeight)
+			throw utils::wruntime_error(_T("The checkpoint belongs to another viewport."));
+
 		// Read buffer with processed lines
 		m_LineMgr.RestoreState(sRetoreDir + _T("\\") + sName + _T(".pos"));
 
-		// Display the current state
-		for (int i = 0; i <= m_LineMgr.GetNumLinesDone(); ++i)
+		// Display the current state, the lines done are not necessarily the first ones
+		for (int i = 0; i < m_nRows; ++i)
 			DrawSingleLine(i);
+
+		bRestored = true;
 	}
 	catch (...)
 	{
@@ -389,15 +1212,27 @@ void SimImpl::Restore(const std::wstring& sPath, const std::wstring& sName)
 		// thats ok, if no restore file exists we start a new calculation
 		m_IdxField.Nullify();
 		m_LenField.Nullify();
+		for (std::size_t i = 0; i < m_vLaneIdx.size(); ++i)
+		{
+			m_vLaneIdx[i]->Nullify();
+			m_vLaneLen[i]->Nullify();
+		}
+		ResizeChannelFields();
 	}
 
+	// Without a checkpoint of its own the calculation starts from the lines other
+	// configurations with the same physics left in the tile cache
+	if (!bRestored && m_TileCache.IsCreated())
+		RestoreTiles();
+
+	EstimateLineCost();
 	DrawModel();
 }
 
 //-------------------------------------------------------------------------------------------
 void SimImpl::ScreenRefresh(int line) const
 {
-	if (line >= m_nCols || line < 0)
+	if (!m_pWnd || line >= m_nCols || line < 0)
 		return;
 
 	if (m_bColorNormalize)
@@ -409,12 +1244,21 @@ void SimImpl::ScreenRefresh(int line) const
 	}
 	else
 		DrawSingleLine(line);
+
+	// Lines receiving mirrored pixels need a refresh too
+	for (int i = 0; i < SymmetryMap::tfCOUNT; ++i)
+	{
+		int xm(0), ym(0);
+		SymmetryMap::ETrafo eTrafo((SymmetryMap::ETrafo)i);
+		if (m_Symmetry.HasTrafo(eTrafo) && m_Symmetry.MapPixel(eTrafo, m_nCols / 2, line, xm, ym) && ym != line)
+			DrawSingleLine(ym);
+	}
 }
 
 //-------------------------------------------------------------------------------------------
 void SimImpl::DrawSingleLine(int y) const
 {
-	if (y <= 0 || y >= m_nRows)
+	if (!m_pWnd || y <= 0 || y >= m_nRows)
 		return;
 
 	assert(m_fMaxTraceLen);
@@ -452,7 +1296,8 @@ void SimImpl::DrawSingleLine(int y) const
 //-------------------------------------------------------------------------------------------
 void SimImpl::DrawTrace(const std::vector<mu::vec2d_type>& vStrip, int idx) const
 {
-	ASSERT(m_pWnd);
+	if (!m_pWnd)
+		return;
 
 	CWndOpenGL::PaintLock lock(m_pWnd);
 	DrawModel();
@@ -473,6 +1318,9 @@ void SimImpl::DrawTrace(const std::vector<mu::vec2d_type>& vStrip, int idx) cons
 //-------------------------------------------------------------------------------------------
 void SimImpl::DrawModel() const
 {
+	if (!m_pWnd)
+		return;
+
 	CWndOpenGL::PaintLock lock(m_pWnd);
 
 	glColor3ub(35, 105, 135);
@@ -489,14 +1337,14 @@ void SimImpl::DrawModel() const
 			(GLubyte)pSrc->GetBlue());
 		if (pSrc->GetType() == ISource::tpLIN)
 		{
-			m_pWnd->DrawCross((int)pSrc->GetPos()[0],
-				(int)pSrc->GetPos()[1],
+			m_pWnd->DrawCross(pSrc->GetPos()[0],
+				pSrc->GetPos()[1],
 				(int)std::max((int)pSrc->GetSize(), 5));
 		}
 		else
 		{
-			m_pWnd->DrawCircle((int)pSrc->GetPos()[0],
-				(int)pSrc->GetPos()[1],
+			m_pWnd->DrawCircle(pSrc->GetPos()[0],
+				pSrc->GetPos()[1],
 				(int)pSrc->GetSize());
 		}
 	} // for all sources
@@ -504,94 +1352,169 @@ void SimImpl::DrawModel() const
 
 
 //-------------------------------------------------------------------------------------------
-/** \brief Calculate Pendulum movement for a given start position.
-	\param pos 2D vector containing the start position.
+/** \brief Returns the index of the source closest to a given position. */
+int SimImpl::FindClosestSource(const mu::vec2d_type& pos) const
+{
+	using mu::sqr;
+
+	// The pendulum height adds the same amount to all distances, comparing the squared
+	// distances in the plane is sufficient.
+	int closest_src(-1);
+	double closest_dist(std::numeric_limits<double>::max());
+	for (std::size_t i = 0; i < m_vpSrc.size(); ++i)
+	{
+		const ISource* const pSrc(m_vpSrc[i]);
+		const double dist(sqr(pSrc->GetPos()[0] - pos[0]) +
+			sqr(pSrc->GetPos()[1] - pos[1]));
+
+		if (dist < closest_dist)
+		{
+			closest_src = (int)i;
+			closest_dist = dist;
+		}
+	}
+
+	return closest_src;
+}
 
+//-------------------------------------------------------------------------------------------
+/** \brief Compute the acceleration caused by the sources at a given position.
+	\param pos The pendulum position.
+	\param acc Receives the acceleration, friction is not included.
+	\param bCapture Set to true if the position is within the capture radius of a source.
+	\param fNear Receives the distance to the closest exactly evaluated source divided by
+	             the larger one of its capture radius and the pendulum height. Linear
+	             sources are not included, their force does not grow close to them.
 	*/
-int SimImpl::Calc(const mu::vec2d_type& start_pos,
-	const mu::vec2d_type& start_vel,
-	trace_buf_type* pvTrace)
+void SimImpl::QuerySourceAcc(const mu::vec2d_type& pos, mu::vec2d_type& acc, bool& bCapture, double& fNear) const
 {
 	using std::sqrt;
 	using mu::sqr;
 
-	mu::vec2d_type pos(start_pos);  // Pendulum position 
-	mu::vec2d_type vel(start_vel);  // Pendulum velovity
+	acc = 0.0;
+	bCapture = false;
+	fNear = std::numeric_limits<double>::max();
+
+	// Far away from the sources the precomputed force field is used. There is no
+	// need for the capture check there, the cells within SIZE of any source are
+	// evaluated exactly.
+	if (m_ForceField.QueryAcc(pos, acc))
+		return;
+
+	// Multipole approximation, sources close by are evaluated exactly
+	if (m_SourceTree.IsCreated())
+	{
+		m_SourceTree.QueryAcc(pos, acc, bCapture, fNear);
+		return;
+	}
+
+	// Specialized kernel for the source layout
+	if (m_pKernel.get())
+	{
+		m_pKernel->QueryAcc(pos, acc, bCapture, fNear);
+		return;
+	}
+
+	// Calculate Force, we deal with Forces proportional
+	// to the distance or the inverse square of the distance
 	mu::vec2d_type r(0, 0);         // position vector
-	mu::vec2d_type acc0(0, 0);      // Pendulum acceleration 
-	mu::vec2d_type acc1(0, 0);      // Pendulum acceleration in next time step
-	mu::vec2d_type acc2(0, 0);      // Pendulum acceleration in previous time step
 	mu::vec2d_type force(0, 0);
+	const double h2(sqr(m_fHeight));
+	double near2(std::numeric_limits<double>::max());
+	for (std::size_t i = 0; i < m_vpSrc.size(); ++i)
+	{
+		const ISource* const pSrc(m_vpSrc[i]);
 
-	// Proxy pointer for fast array exchange
-	mu::vec2d_type* tmp(nullptr);
-	mu::vec2d_type* acc_p(&acc0); // previous
-	mu::vec2d_type* acc(&acc1);   // current
-	mu::vec2d_type* acc_n(&acc2); // next
-	double t(0), dt(m_fTimeStep), len(0);
-	const std::size_t src_num(m_vpSrc.size());
-	int closest_src(-1);
+		// position vetor
+		r[0] = pos[0] - pSrc->GetPos()[0];
+		r[1] = pos[1] - pSrc->GetPos()[1];
 
-	if (pvTrace)
-		pvTrace->clear();
+		const double planar2(sqr(r[0]) + sqr(r[1])),
+			size2(sqr(pSrc->GetSize()));
+		pSrc->QueryForce(force, r, sqrt(planar2 + h2));
+		acc[0] -= force[0];
+		acc[1] -= force[1];
+
+		// Check for end condition
+		if (planar2 < size2)
+			bCapture = true;
+
+		if (pSrc->GetType() != ISource::tpLIN)
+			near2 = std::min(near2, planar2 / std::max(size2, h2));
+	} // for (all Magnets)
+
+	fNear = sqrt(near2);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate the pendulum movement using the Beeman scheme with a fixed time step.
+	\return Index of the closest source at the end of the trajectory.
+
+	Close to a source the time step is divided into SUBSTEP_NUM sub steps. Step counts and
+	the trace length are measured in units of the base time step.
+
+	The integration is done in the precision given by T, trace length and step counts
+	are always accumulated in double precision.
+
+	\param s The integrator state, the integration continues where it stopped before.
+	\param nMaxSteps Stop once the integrated time reaches this many base time steps.
+	\param bCaptured Set to true if the pendulum was captured by a source.
+	*/
+template<typename T>
+int SimImpl::IntegrateBeeman(SPendState& s,
+	int nMaxSteps,
+	trace_buf_type* pvTrace,
+	bool& bCaptured) const
+{
+	using mu::sqr;
+	typedef mu::Vector<T, 2> vec_type;
+
+	vec_type pos((T)s.pos[0], (T)s.pos[1]);     // Pendulum position
+	vec_type vel((T)s.vel[0], (T)s.vel[1]);     // Pendulum velovity
+	vec_type acc0((T)s.acc_p[0], (T)s.acc_p[1]); // Pendulum acceleration in previous time step
+	vec_type acc1((T)s.acc[0], (T)s.acc[1]);    // Pendulum acceleration 
+	vec_type acc2(0, 0);                        // Pendulum acceleration in next time step
+
+	// Proxy pointer for fast array exchange
+	vec_type* tmp(nullptr);
+	vec_type* acc_p(&acc0); // previous
+	vec_type* acc(&acc1);   // current
+	vec_type* acc_n(&acc2); // next
+	const T friction((T)m_fFriction);
+	T dt((T)s.dt), speed(abs(vel));
+	double& steps(s.steps);
+	double& len(s.len);
+	int& ct(s.ct);
 
 	bool  bRunning(true);
-	for (int ct = 0; ct < m_nMaxSteps && bRunning; ++ct)
+	for (; steps < nMaxSteps && bRunning; ++ct)
 	{
 		assert(acc_p);
 		assert(acc);
 		assert(acc_n);
 
 		// compute new position
-		t += dt;
-		pos[0] += vel[0] * dt + sqr(dt) * (2.0 / 3.0 * (*acc)[0] - 1.0 / 6.0 * (*acc_p)[0]);
-		pos[1] += vel[1] * dt + sqr(dt) * (2.0 / 3.0 * (*acc)[1] - 1.0 / 6.0 * (*acc_p)[1]);
+		pos[0] += vel[0] * dt + sqr(dt) * (T(2.0 / 3.0) * (*acc)[0] - T(1.0 / 6.0) * (*acc_p)[0]);
+		pos[1] += vel[1] * dt + sqr(dt) * (T(2.0 / 3.0) * (*acc)[1] - T(1.0 / 6.0) * (*acc_p)[1]);
 
 		if (pvTrace && ct % 10 == 0)
-			pvTrace->push_back(pos);
-
-		// Reset accelleration
-		(*acc_n) = 0.0;
-
-		// Calculate Force, we deal with Forces proportional
-		// to the distance or the inverse square of the distance
-		double closest_dist(std::numeric_limits<double>::max());
-		for (std::size_t i = 0; i < src_num; ++i)
-		{
-			const ISource* const pSrc(m_vpSrc[i]);
-			const double dist(sqrt(sqr(pSrc->GetPos()[0] - pos[0]) +
-				sqr(pSrc->GetPos()[1] - pos[1]) +
-				sqr(m_fHeight)));
-
-			// Determine closest source index and distance
-			if (dist < closest_dist)
-			{
-				closest_src = (int)i;
-				closest_dist = dist;
-			}
+			pvTrace->push_back(mu::vec2d_type(pos[0], pos[1]));
 
-			// position vetor
-			r[0] = pos[0] - pSrc->GetPos()[0];
-			r[1] = pos[1] - pSrc->GetPos()[1];
+		// Calculate the acceleration caused by the sources
+		bool bCapture(false);
+		T fNear(0);
+		QuerySourceAcc(pos, *acc_n, bCapture, fNear);
 
-			pSrc->QueryForce(force, r, dist);
-			(*acc_n)[0] -= force[0];
-			(*acc_n)[1] -= force[1];
-
-			// Check for end condition
-			if (ct > m_nMinSteps && abs(r) < pSrc->GetSize() && abs(vel) < m_fAbortVel)
-			{
-				bRunning = false;
-				continue;
-			}
-		} // for (all Magnets)
+		// Check for end condition
+		if (bCapture && steps > m_nMinSteps && speed < m_fAbortVel)
+			bRunning = false;
 
 		//--------------------------------------------------------------
 		// 3.) We have now the acceleration vector containing the influence of all 
 		//     forcefied sources, now we need to apply friction proporional to the
 		//     velocity.
-		(*acc_n)[0] -= vel[0] * m_fFriction;
-		(*acc_n)[1] -= vel[1] * m_fFriction;
+		(*acc_n)[0] -= vel[0] * friction;
+		(*acc_n)[1] -= vel[1] * friction;
 
 		//--------------------------------------------------------------
 		// 4.) We are almost done, finally we need to compute the new velocity
@@ -599,8 +1522,8 @@ int SimImpl::Calc(const mu::vec2d_type& start_pos,
 		//     
 		//     http://en.wikipedia.org/wiki/Beeman%27s_algorithm#Equation
 		//    
-		vel[0] += dt * (1.0 / 3.0 * (*acc_n)[0] + 5.0 / 6.0 * (*acc)[0] - 1.0 / 6.0 * (*acc_p)[0]);
-		vel[1] += dt * (1.0 / 3.0 * (*acc_n)[1] + 5.0 / 6.0 * (*acc)[1] - 1.0 / 6.0 * (*acc_p)[1]);
+		vel[0] += dt * (T(1.0 / 3.0) * (*acc_n)[0] + T(5.0 / 6.0) * (*acc)[0] - T(1.0 / 6.0) * (*acc_p)[0]);
+		vel[1] += dt * (T(1.0 / 3.0) * (*acc_n)[1] + T(5.0 / 6.0) * (*acc)[1] - T(1.0 / 6.0) * (*acc_p)[1]);
 
 		//--------------------------------------------------------------
 		// 5.) flip the acc buffer
@@ -609,22 +1532,992 @@ int SimImpl::Calc(const mu::vec2d_type& start_pos,
 		acc = acc_n;
 		acc_n = tmp;
 
-		len += abs(vel);
+		speed = abs(vel);
+		len += speed * (dt / m_fTimeStep);
+		steps += dt / m_fTimeStep;
+
+		//--------------------------------------------------------------
+		// 6.) Sub stepping close to the sources. Beeman integration assumes a
+		//     constant step size, the acceleration history is dropped whenever
+		//     the step size changes.
+		const T dt_next((T)((fNear < m_fSubstepDist) ? m_fTimeStep / m_nSubsteps : m_fTimeStep));
+		if (dt_next != dt)
+		{
+			*acc_p = *acc;
+			dt = dt_next;
+		}
 	}  // for (trace pendulum movement)
 
+	s.pos.Assign(pos[0], pos[1]);
+	s.vel.Assign(vel[0], vel[1]);
+	s.acc.Assign((*acc)[0], (*acc)[1]);
+	s.acc_p.Assign((*acc_p)[0], (*acc_p)[1]);
+	s.dt = dt;
+	bCaptured = !bRunning;
+
+	// Only the final position is classified
+	return FindClosestSource(s.pos);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate the pendulum movement using the Dormand-Prince 5(4) scheme.
+	\return Index of the closest source at the end of the trajectory.
+
+	The step size is adapted to keep the local error below INTEGRATOR_TOL. MIN_STEPS and
+	MAX_STEPS are converted into simulation times using DELTA_T, MAX_STEPS additionally
+	limits the number of steps. The trace length is weighted with dt / DELTA_T so that it
+	stays comparable to the fixed step integrator.
+
+	http://en.wikipedia.org/wiki/Dormand%E2%80%93Prince_method
+
+	\param s The integrator state, the integration continues where it stopped before.
+	\param nMaxSteps Stop once the integrated time reaches this many base time steps.
+	\param bCaptured Set to true if the pendulum was captured by a source.
+	*/
+int SimImpl::IntegrateDopri(SPendState& s,
+	int nMaxSteps,
+	trace_buf_type* pvTrace,
+	bool& bCaptured) const
+{
+	using std::sqrt;
+	using std::pow;
+	using mu::sqr;
+
+	// Butcher tableau, the last row are the weights of the 5th order solution
+	static const double a[7][6] = {
+		{ 0 },
+		{ 1.0 / 5 },
+		{ 3.0 / 40, 9.0 / 40 },
+		{ 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+		{ 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+		{ 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+		{ 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 } };
+
+	// Difference of the 5th and 4th order weights
+	static const double e[7] = { 71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40 };
+
+	// State vector is (x, y, vx, vy)
+	auto deriv = [this](const double* y, double* dy, bool& bCapture)
+	{
+		mu::vec2d_type acc;
+		double fNear(0);
+		QuerySourceAcc(mu::vec2d_type(y[0], y[1]), acc, bCapture, fNear);
+		dy[0] = y[2];
+		dy[1] = y[3];
+		dy[2] = acc[0] - y[2] * m_fFriction;
+		dy[3] = acc[1] - y[3] * m_fFriction;
+	};
+
+	const double t_min(m_nMinSteps * m_fTimeStep),
+		t_max(nMaxSteps * m_fTimeStep);
+	double y[4] = { s.pos[0], s.pos[1], s.vel[0], s.vel[1] }, ys[4], k[7][4];
+	double t(s.steps * m_fTimeStep), &dt(s.dt), &len(s.len);
+	bool bCapture(false);
+	deriv(y, k[0], bCapture);
+
+	bool  bRunning(true);
+	for (; s.ct < m_nMaxSteps && bRunning && t < t_max; ++s.ct)
+	{
+		dt = std::min(dt, t_max - t);
+
+		// Stages, the last one is evaluated at the new solution (first same as last)
+		for (int st = 1; st < 7; ++st)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				double sum(0);
+				for (int j = 0; j < st; ++j)
+					sum += a[st][j] * k[j][i];
+
+				ys[i] = y[i] + dt * sum;
+			}
+
+			deriv(ys, k[st], bCapture);
+		}
+
+		// Local error estimate, mixed absolute and relative tolerance
+		double err(0);
+		for (int i = 0; i < 4; ++i)
+		{
+			double sum(0);
+			for (int j = 0; j < 7; ++j)
+				sum += e[j] * k[j][i];
+
+			const double sc(m_fTolerance * (1 + std::max(std::fabs(y[i]), std::fabs(ys[i]))));
+			err += sqr(dt * sum / sc);
+		}
+		err = sqrt(err / 4);
+
+		if (err <= 1)
+		{
+			t += dt;
+			for (int i = 0; i < 4; ++i)
+			{
+				y[i] = ys[i];
+				k[0][i] = k[6][i];
+			}
+
+			const double speed(sqrt(sqr(y[2]) + sqr(y[3])));
+			len += speed * dt / m_fTimeStep;
+
+			if (pvTrace)
+				pvTrace->push_back(mu::vec2d_type(y[0], y[1]));
+
+			// Check for end condition
+			if (t > t_min && bCapture && speed < m_fAbortVel)
+				bRunning = false;
+		}
+
+		// New step size
+		const double fac((err > 0) ? 0.9 * pow(err, -0.2) : 5.0);
+		dt = std::min(dt * std::min(5.0, std::max(0.2, fac)), m_fMaxTimeStep);
+	}  // for (trace pendulum movement)
+
+	s.pos[0] = y[0];
+	s.pos[1] = y[1];
+	s.vel[0] = y[2];
+	s.vel[1] = y[3];
+	s.steps = t / m_fTimeStep;
+	bCaptured = !bRunning;
+
+	// Only the final position is classified
+	return FindClosestSource(s.pos);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate all lanes of a parameter sweep in lockstep using the Beeman scheme.
+
+	Each lane follows the same steps as IntegrateBeeman with the parameters of its lane.
+	The lane data is kept in separate arrays per component so the loops over the lanes
+	can be vectorized. Lanes that are done are removed from the slots, the loop ends
+	once all lanes are done.
+
+	\param vs The integrator states, one per lane.
+	\param vIdx Receives the index of the closest source at the end of each trajectory.
+	\param pvTrace Receives the trajectory of lane 0.
+	*/
+void SimImpl::IntegrateLanes(SPendState* vs, int* vIdx, trace_buf_type* pvTrace) const
+{
+	using std::sqrt;
+
+	enum { N = SweepLanes::MAX_LANES };
+	SweepLanes::SSlots slots;
+	m_SweepLanes.InitSlots(slots);
+
+	// Per slot state, the acceleration buffers hold the previous, current and next time step
+	double px[N], py[N], vx[N], vy[N], ax[3][N], ay[3][N], dt[N], speed[N], near[N];
+	bool capture[N], done[N];
+	int p(0), c(1), n(2);
+
+	auto load = [&](int i)
+	{
+		const SPendState& s(vs[slots.lane[i]]);
+		px[i] = s.pos[0];
+		py[i] = s.pos[1];
+		vx[i] = s.vel[0];
+		vy[i] = s.vel[1];
+		ax[p][i] = s.acc_p[0];
+		ay[p][i] = s.acc_p[1];
+		ax[c][i] = s.acc[0];
+		ay[c][i] = s.acc[1];
+		dt[i] = s.dt;
+		speed[i] = sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+		done[i] = s.steps >= m_nMaxSteps;
+	};
+
+	auto store = [&](int i)
+	{
+		SPendState& s(vs[slots.lane[i]]);
+		s.pos.Assign(px[i], py[i]);
+		s.vel.Assign(vx[i], vy[i]);
+		s.acc.Assign(ax[c][i], ay[c][i]);
+		s.acc_p.Assign(ax[p][i], ay[p][i]);
+		s.dt = dt[i];
+	};
+
+	auto move = [&](int to, int from)
+	{
+		px[to] = px[from];
+		py[to] = py[from];
+		vx[to] = vx[from];
+		vy[to] = vy[from];
+		for (int k = 0; k < 3; ++k)
+		{
+			ax[k][to] = ax[k][from];
+			ay[k][to] = ay[k][from];
+		}
+		dt[to] = dt[from];
+		speed[to] = speed[from];
+		done[to] = done[from];
+		SweepLanes::MoveSlot(slots, to, from);
+	};
+
+	// Remove the lanes that are done, the last slot moves into their place
+	auto compact = [&]()
+	{
+		for (int i = 0; i < slots.num;)
+		{
+			if (!done[i])
+			{
+				++i;
+				continue;
+			}
+
+			store(i);
+			move(i, --slots.num);
+		}
+	};
+
+	for (int i = 0; i < slots.num; ++i)
+		load(i);
+
+	for (compact(); slots.num > 0; compact())
+	{
+		for (int i = 0; i < slots.num; ++i)
+		{
+			px[i] += vx[i] * dt[i] + dt[i] * dt[i] * (2.0 / 3.0 * ax[c][i] - 1.0 / 6.0 * ax[p][i]);
+			py[i] += vy[i] * dt[i] + dt[i] * dt[i] * (2.0 / 3.0 * ay[c][i] - 1.0 / 6.0 * ay[p][i]);
+		}
+
+		for (int i = 0; pvTrace && i < slots.num; ++i)
+		{
+			if (slots.lane[i] == 0 && vs[0].ct % 10 == 0)
+				pvTrace->push_back(mu::vec2d_type(px[i], py[i]));
+		}
+
+		m_SweepLanes.QueryAcc(slots, px, py, ax[n], ay[n], capture, near);
+
+		for (int i = 0; i < slots.num; ++i)
+		{
+			SPendState& s(vs[slots.lane[i]]);
+			const bool bRunning(!(capture[i] && s.steps > m_nMinSteps && speed[i] < m_fAbortVel));
+
+			ax[n][i] -= vx[i] * slots.friction[i];
+			ay[n][i] -= vy[i] * slots.friction[i];
+			vx[i] += dt[i] * (1.0 / 3.0 * ax[n][i] + 5.0 / 6.0 * ax[c][i] - 1.0 / 6.0 * ax[p][i]);
+			vy[i] += dt[i] * (1.0 / 3.0 * ay[n][i] + 5.0 / 6.0 * ay[c][i] - 1.0 / 6.0 * ay[p][i]);
+
+			speed[i] = sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+			s.len += speed[i] * (dt[i] / m_fTimeStep);
+			s.steps += dt[i] / m_fTimeStep;
+			++s.ct;
+
+			// Sub stepping drops the acceleration history, the buffers are rotated below
+			const double dt_next((near[i] < m_fSubstepDist) ? m_fTimeStep / m_nSubsteps : m_fTimeStep);
+			if (dt_next != dt[i])
+			{
+				ax[c][i] = ax[n][i];
+				ay[c][i] = ay[n][i];
+				dt[i] = dt_next;
+			}
+
+			done[i] = !bRunning || s.steps >= m_nMaxSteps;
+		}
+
+		const int tmp(p);
+		p = c;
+		c = n;
+		n = tmp;
+	}
+
+	// Only the final position is classified
+	for (int l = 0; l < m_SweepLanes.GetLanes(); ++l)
+	{
+		vIdx[l] = FindClosestSource(vs[l].pos);
+		RuntimeMetrics::AddSteps(vs[l].ct);
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the integrator state for a new start position. */
+void SimImpl::InitState(SPendState& s, const mu::vec2d_type& start_pos, const mu::vec2d_type& start_vel, int x, int y) const
+{
+	s.pos = start_pos;
+	s.vel = start_vel;
+	s.acc = 0.0;
+	s.acc_p = 0.0;
+	s.len = 0;
+	s.steps = 0;
+	s.dt = m_fTimeStep;
+	s.ct = 0;
+	s.x = x;
+	s.y = y;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Continue the integration of a grid point.
+	\param s The integrator state.
+	\param nMaxSteps Step limit of this call.
+	\param bCaptured Set to true if the pendulum was captured by a source.
+	\return Index of the closest source at the end of the integration.
+	*/
+int SimImpl::Integrate(SPendState& s, int nMaxSteps, trace_buf_type* pvTrace, bool& bCaptured) const
+{
+	const int ct(s.ct);
+	int idx(0);
+	if (m_eIntegrator == inDOPRI5)
+		idx = IntegrateDopri(s, nMaxSteps, pvTrace, bCaptured);
+	else
+		idx = (m_ePrecision == prFLOAT) ? IntegrateBeeman<float>(s, nMaxSteps, pvTrace, bCaptured) :
+			IntegrateBeeman<double>(s, nMaxSteps, pvTrace, bCaptured);
+
+	RuntimeMetrics::AddSteps(s.ct - ct);
+	return idx;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Compare the classification of double and single precision integration.
+	\param nSamples Approximate number of grid points to check.
+	\return The fraction of grid points classified differently.
+
+	The grid points are taken from a regular sub grid of the simulation field.
+	*/
+double SimImpl::CheckPrecision(int nSamples) const
+{
+	const int nStep(std::max(1, (int)std::sqrt((double)m_nCols * m_nRows / std::max(nSamples, 1))));
+	int nChecked(0), nMismatch(0);
+	for (int y = nStep / 2; y < m_nRows; y += nStep)
+	{
+		for (int x = nStep / 2; x < m_nCols; x += nStep)
+		{
+			mu::vec2d_type start_pos(0, 0);
+			GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+
+			SPendState s_dbl, s_flt;
+			InitState(s_dbl, start_pos, mu::vec2d_type(0, 0), x, y);
+			InitState(s_flt, start_pos, mu::vec2d_type(0, 0), x, y);
+
+			bool bCaptured(false);
+			int idx_dbl(IntegrateBeeman<double>(s_dbl, m_nMaxSteps, nullptr, bCaptured)),
+				idx_flt(IntegrateBeeman<float>(s_flt, m_nMaxSteps, nullptr, bCaptured));
+
+			++nChecked;
+			if (idx_dbl != idx_flt)
+				++nMismatch;
+		}
+	}
+
+	return (nChecked) ? (double)nMismatch / nChecked : 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Run the precision check if requested by PRECISION_CHECK.
+
+	The result is appended to the file [name].precision.txt next to the bitmap.
+	*/
+void SimImpl::RunPrecisionCheck(const std::wstring& sPath, const std::wstring& sName) const
+{
+	if (m_nPrecisionCheck <= 0)
+		return;
+
+	const double fRate(CheckPrecision(m_nPrecisionCheck));
+	TRACE(_T("Precision check: %.3f%% of the grid points classified differently\n"), fRate * 100);
+
+	std::wstring sFile(sPath.length() ? sPath + _T("\\") + sName + _T(".precision.txt") :
+		sName + _T(".precision.txt"));
+	std::wofstream ofs(sFile.c_str(), std::ios::out | std::ios::app);
+	ofs << _T("samples=") << m_nPrecisionCheck
+		<< _T(" mismatch_rate=") << fRate << std::endl;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Single precision source evaluation.
+
+	Only the specialized kernels are evaluated in single precision, the force field, the
+	force tree and the generic evaluation are done in double precision.
+	*/
+void SimImpl::QuerySourceAcc(const mu::vec2f_type& pos, mu::vec2f_type& acc, bool& bCapture, float& fNear) const
+{
+	if (m_pKernel.get() && !m_ForceField.GetRes() && !m_SourceTree.IsCreated())
+	{
+		acc = 0.0f;
+		bCapture = false;
+		m_pKernel->QueryAcc(pos, acc, bCapture, fNear);
+		return;
+	}
+
+	mu::vec2d_type acc_dbl(0, 0);
+	double near_dbl(0);
+	QuerySourceAcc(mu::vec2d_type(pos[0], pos[1]), acc_dbl, bCapture, near_dbl);
+	acc[0] = (float)acc_dbl[0];
+	acc[1] = (float)acc_dbl[1];
+	fNear = (float)std::min(near_dbl, (double)std::numeric_limits<float>::max());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate Pendulum movement for a given start position.
+	\param pos 2D vector containing the start position.
+
+	*/
+int SimImpl::Calc(const mu::vec2d_type& start_pos,
+	const mu::vec2d_type& start_vel,
+	trace_buf_type* pvTrace)
+{
+	if (pvTrace)
+		pvTrace->clear();
 
-	// store the data, thread safety should not be an issue here
-	// no two threads will write the same line, no buffer changes...
 	int x(0), y(0);
 	ModelCoordToWin(start_pos[0], start_pos[1], x, y);
+
+	SPendState s;
+	InitState(s, start_pos, start_vel, x, y);
+
+	bool bCaptured(false);
+	int closest_src(Integrate(s, m_nMaxSteps, pvTrace, bCaptured));
+
+	// store the data, thread safety should not be an issue here
+	// no two threads will write the same line, no buffer changes...
 	if (x < 0 || x >= (int)m_IdxField.SizeCol())
 		return -1;
 
 	if (y < 0 || y >= (int)m_IdxField.SizeRow())
 		return -1;
 
-	m_IdxField[y][x] = closest_src;
-	m_LenField[y][x] = len;
+	StoreResult(x, y, closest_src, s.len);
+	StoreChannels(s, bCaptured);
+	return closest_src;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate a start position without storing the result.
+	\param nSteps Receives the number of integration steps.
+	\return Index of the closest source at the end of the trajectory.
+	*/
+int SimImpl::CalcSteps(const mu::vec2d_type& start_pos, int& nSteps) const
+{
+	int x(0), y(0);
+	ModelCoordToWin(start_pos[0], start_pos[1], x, y);
+
+	SPendState s;
+	InitState(s, start_pos, mu::vec2d_type(0, 0), x, y);
+
+	bool bCaptured(false);
+	int idx(Integrate(s, m_nMaxSteps, nullptr, bCaptured));
+	nSteps = s.ct;
+	return idx;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate the trajectory of an interactive probe.
+	\param bCancel Set by another thread to abandon the probe.
+	\return false if the probe was cancelled or the sources were replaced meanwhile.
+
+	The result fields are not touched, probes run concurrently to the worker threads. The
+	integration is done in chunks so a cancel request is noticed quickly. Like a resumed
+	pass the Dormand-Prince integrator shortens the last step of each chunk.
+	*/
+bool SimImpl::Probe(const mu::vec2d_type& start_pos, trace_buf_type& vTrace, int& idx, const volatile bool& bCancel) const
+{
+	const int nChunk = 2000;
+
+	vTrace.clear();
+
+	int x(0), y(0);
+	ModelCoordToWin(start_pos[0], start_pos[1], x, y);
+
+	SPendState s;
+	InitState(s, start_pos, mu::vec2d_type(0, 0), x, y);
+
+	int nVersion(0);
+	{
+		au::AutoLock<CCriticalSection> lock(&m_SourceLock);
+		nVersion = m_nSourceVersion;
+	}
+
+	bool bCaptured(false);
+	idx = -1;
+	while (!bCaptured && s.steps < m_nMaxSteps)
+	{
+		if (bCancel)
+			return false;
+
+		// Animation frames and the autotuner replace the sources and the kernel while the
+		// probe runs, the trace of the old sources is dropped.
+		au::AutoLock<CCriticalSection> lock(&m_SourceLock);
+		if (m_nSourceVersion != nVersion)
+			return false;
+
+		const double fSteps(s.steps);
+		const int nSteps((int)std::min(s.steps + nChunk, (double)m_nMaxSteps));
+		idx = Integrate(s, nSteps, &vTrace, bCaptured);
+
+		// The Dormand-Prince integrator has its own limit on the number of steps
+		if (s.steps == fSteps || (m_eIntegrator == inDOPRI5 && s.ct >= m_nMaxSteps))
+			break;
+	}
+
+	return !bCancel;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate a grid point within the current pass.
+
+	Grid points not resolved within the step limit of the current pass keep their
+	integrator state in the side table of their line so the next pass can resume them.
+	Their preliminary result is stored anyway.
+	*/
+int SimImpl::CalcPixel(int x, int y, trace_buf_type* pvTrace)
+{
+	if (m_SweepLanes.IsCreated())
+		return CalcLanes(x, y, pvTrace);
+
+	if (pvTrace)
+		pvTrace->clear();
+
+	SPendState s;
+	mu::vec2d_type start_pos(0, 0);
+	GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+
+	// Grid points of earlier renders
+	int cached_src(0);
+	double cached_len(0);
+	if (m_SampleCache.IsCreated() && m_SampleCache.Lookup(start_pos, cached_src, cached_len))
+	{
+		StoreResult(x, y, cached_src, cached_len);
+		SetChannels(x, y, tmCACHED, 0, 0, mu::vec2d_type(0, 0));
+		return cached_src;
+	}
+
+	InitState(s, start_pos, mu::vec2d_type(0, 0), x, y);
+
+	bool bCaptured(false);
+	int closest_src(Integrate(s, GetSoftLimit(s), pvTrace, bCaptured));
+	Defer(s, bCaptured);
+	CacheResult(s, closest_src, bCaptured);
+
+	StoreResult(x, y, closest_src, s.len);
+	StoreChannels(s, bCaptured);
+	return closest_src;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate a grid point for all lanes of a parameter sweep.
+	\return Index of the closest source of lane 0.
+
+	Lane 0 is stored in the main result fields, the other lanes in their own fields. Only
+	the trajectory of lane 0 is traced.
+	*/
+int SimImpl::CalcLanes(int x, int y, trace_buf_type* pvTrace)
+{
+	if (pvTrace)
+		pvTrace->clear();
+
+	mu::vec2d_type start_pos(0, 0);
+	GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+
+	SPendState vs[SweepLanes::MAX_LANES];
+	int vIdx[SweepLanes::MAX_LANES];
+	const int nLanes(m_SweepLanes.GetLanes());
+	for (int l = 0; l < nLanes; ++l)
+		InitState(vs[l], start_pos, mu::vec2d_type(0, 0), x, y);
+
+	IntegrateLanes(vs, vIdx, pvTrace);
+
+	// Sweeps integrate up to MAX_STEPS in a single pass, lanes stopping earlier are captured
+	StoreResult(x, y, vIdx[0], vs[0].len);
+	StoreChannels(vs[0], vs[0].steps < m_nMaxSteps);
+	for (int l = 1; l < nLanes; ++l)
+		SetPixel(*m_vLaneIdx[l - 1], *m_vLaneLen[l - 1], x, y, vIdx[l], vs[l].len);
+
+	return vIdx[0];
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Resume all unresolved grid points of a line using the step limit of the current pass.
+	\return Number of grid points integrated.
+	*/
+int SimImpl::ResumeLine(int y)
+{
+	if (y < 0 || y >= (int)m_vPending.size())
+		return 0;
+
+	if (m_bFillPass)
+	{
+		FillLine(y);
+		return 0;
+	}
+
+	// Stragglers of this line may be deferred by other threads at the same time
+	std::vector<SPendState> vState;
+	{
+		au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+		vState.swap(m_vPending[y]);
+	}
+
+	for (std::size_t i = 0; i < vState.size(); ++i)
+	{
+		SPendState& s(vState[i]);
+
+		bool bCaptured(false);
+		int closest_src(Integrate(s, GetSoftLimit(s), nullptr, bCaptured));
+		Defer(s, bCaptured);
+		CacheResult(s, closest_src, bCaptured);
+
+		StoreResult(s.x, s.y, closest_src, s.len);
+		StoreChannels(s, bCaptured);
+	}
+
+	return (int)vState.size();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Step limit for the regular work on a grid point.
+
+	With STRAGGLER_STEPS set a grid point may only use this many steps before it is moved
+	to the straggler queue.
+	*/
+int SimImpl::GetSoftLimit(const SPendState& s) const
+{
+	if (m_nStragglerSteps <= 0)
+		return m_nPassSteps;
+
+	return (int)std::min((double)m_nPassSteps, s.steps + m_nStragglerSteps);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Keep the state of a grid point that is not resolved yet.
+
+	Grid points that ran out of their soft step budget are moved to the straggler queue,
+	grid points that reached the step limit of the pass are resumed in the next pass.
+	Every access to these tables takes the straggler lock.
+	*/
+void SimImpl::Defer(const SPendState& s, bool bCaptured)
+{
+	if (bCaptured)
+		return;
+
+	// The tables are shared with the threads resuming stragglers
+	au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+	if (s.steps < m_nPassSteps)
+		m_vStraggler.push_back(s);
+	else if (m_nPassSteps < m_nMaxSteps)
+		m_vPending[s.y].push_back(s);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Fetch a grid point from the straggler queue.
+	\return false if the queue is empty.
+
+	Call FlagStragglerDone once the grid point is calculated.
+	*/
+bool SimImpl::QueryStraggler(SPendState& s)
+{
+	au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+	if (m_vStraggler.empty())
+		return false;
+
+	s = m_vStraggler.back();
+	m_vStraggler.pop_back();
+	m_vStragglerBusy.push_back(s.y);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Finish a grid point from the straggler queue using the step limit of the pass. */
+void SimImpl::ResumeStraggler(SPendState& s)
+{
+	bool bCaptured(false);
+	int closest_src(Integrate(s, m_nPassSteps, nullptr, bCaptured));
+	if (!bCaptured && m_nPassSteps < m_nMaxSteps)
+	{
+		// Other threads may work on stragglers of the same line
+		au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+		m_vPending[s.y].push_back(s);
+	}
+
+	CacheResult(s, closest_src, bCaptured);
+	StoreResult(s.x, s.y, closest_src, s.len);
+	StoreChannels(s, bCaptured);
+}
+
+//-------------------------------------------------------------------------------------------
+void SimImpl::FlagStragglerDone(int y)
+{
+	{
+		au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+		std::vector<int>::iterator it(std::find(m_vStragglerBusy.begin(), m_vStragglerBusy.end(), y));
+		if (it != m_vStragglerBusy.end())
+			m_vStragglerBusy.erase(it);
+	}
+
+	CheckPassDone();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Estimate the integration steps of each line and queue the expensive lines first.
+
+	The steps are sampled on a lattice of about SCHEDULE_SAMPLES grid points, the lines
+	between the lattice rows are interpolated. The pre-pass runs on the UI thread before the
+	workers start, so the samples only get a few times MIN_STEPS. Samples hitting this cap
+	are the expensive ones, which is all the ordering needs. The samples are not stored,
+	ReportLineCost refines the estimates as the lines are finished.
+	*/
+void SimImpl::EstimateLineCost()
+{
+	if (!m_bCostSchedule)
+		return;
+
+	TraceRecorder::Scope trace(_T("estimate cost"));
+
+	// Step cap of a sample, in multiples of MIN_STEPS but never below a floor
+	const int COST_STEPS_FACTOR = 4;
+	const int COST_STEPS_FLOOR = 1000;
+	const int nCostSteps(std::max(COST_STEPS_FACTOR * m_nMinSteps, COST_STEPS_FLOOR));
+
+	const int nStep(std::max(1, (int)std::sqrt((double)m_nCols * m_nRows / m_nScheduleSamples)));
+	m_vLineCost.assign(m_nRows, 0);
+	m_vCostKnown.assign(m_nRows, false);
+
+	int nLast(-1);
+	for (int y = nStep / 2; y < m_nRows; y += nStep)
+	{
+		double fSteps(0);
+		int nSamples(0);
+		for (int x = nStep / 2; x < m_nCols; x += nStep, ++nSamples)
+		{
+			// Symmetric images cost nothing
+			if (!NeedsCalc(x, y))
+				continue;
+
+			mu::vec2d_type start_pos(0, 0);
+			GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+
+			SPendState s;
+			InitState(s, start_pos, mu::vec2d_type(0, 0), x, y);
+
+			bool bCaptured(false);
+			Integrate(s, std::min(GetSoftLimit(s), nCostSteps), nullptr, bCaptured);
+			fSteps += s.ct;
+		}
+
+		m_vLineCost[y] = (nSamples) ? fSteps * m_nCols / nSamples : 0;
+		m_vCostKnown[y] = true;
+		InterpolateLineCost(nLast, y);
+		nLast = y;
+	}
+
+	InterpolateLineCost(nLast, m_nRows);
+	m_LineMgr.SortByCost(m_vLineCost);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Interpolate the cost of the lines between two lines of known cost.
+
+	A line index outside of the field continues the cost of the other line.
+	*/
+void SimImpl::InterpolateLineCost(int y0, int y1)
+{
+	const bool bHas0(y0 >= 0),
+		bHas1(y1 < m_nRows);
+
+	for (int y = y0 + 1; y < y1; ++y)
+	{
+		if (bHas0 && bHas1)
+			m_vLineCost[y] = m_vLineCost[y0] + (m_vLineCost[y1] - m_vLineCost[y0]) * (y - y0) / (y1 - y0);
+		else if (bHas0)
+			m_vLineCost[y] = m_vLineCost[y0];
+		else if (bHas1)
+			m_vLineCost[y] = m_vLineCost[y1];
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns true if this is not the first pass of a two pass calculation. */
+bool SimImpl::IsResumePass() const
+{
+	return m_nPass > 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns true if further passes may follow the current one. */
+bool SimImpl::HasMorePasses() const
+{
+	return m_nPassSteps < m_nMaxSteps;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Start the next pass if there are unresolved grid points left.
+
+	Only lines with unresolved grid points are queued again. The step limit grows by
+	PASS_GROWTH per pass until it reaches MAX_STEPS. Animation frames predicted from their
+	predecessor queue the lines with predicted grid points instead.
+	*/
+void SimImpl::StartNextPass()
+{
+	// Animation frames fill in their predicted grid points in a pass of their own
+	if (m_Animation.HasPrediction() && !m_bFillPass)
+	{
+		std::vector<int> vLines;
+		for (int y = 0; y < m_nRows; ++y)
+		{
+			for (int x = 0; x < m_nCols; ++x)
+			{
+				if (m_Animation.GetPrediction(x, y) >= 0)
+				{
+					vLines.push_back(y);
+					break;
+				}
+			}
+		}
+
+		m_bFillPass = true;
+		if (vLines.size())
+		{
+			++m_nPass;
+			m_LineMgr.Reset(vLines);
+			return;
+		}
+	}
+
+	if (!HasMorePasses())
+		return;
+
+	std::vector<int> vLines;
+	for (int y = 0; y < (int)m_vPending.size(); ++y)
+	{
+		if (m_vPending[y].size())
+			vLines.push_back(y);
+	}
+
+	if (vLines.empty())
+	{
+		m_nPassSteps = m_nMaxSteps;
+		return;
+	}
+
+	++m_nPass;
+	m_nPassSteps = (int)std::min((double)m_nMaxSteps, (double)m_nPassSteps * m_fPassGrowth);
+	m_LineMgr.Reset(vLines);
+
+	// Lines with the most unresolved grid points first
+	if (m_bCostSchedule)
+	{
+		std::vector<double> vCost(m_nRows, 0);
+		for (int y = 0; y < (int)m_vPending.size(); ++y)
+			vCost[y] = (double)m_vPending[y].size();
+
+		m_LineMgr.SortByCost(vCost);
+	}
+
+	TRACE(_T("Pass %d: %d lines left, step limit %d\n"), m_nPass, (int)vLines.size(), m_nPassSteps);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Write a finished animation frame and start the next one.
+	\return true if the next frame was started, false if there is no animation or the
+			last frame is done.
+
+	Frames are written to [name].[frame].bmp. Call this once IsDone returns true, only
+	one thread may call it at a time.
+	*/
+bool SimImpl::FinishFrame(const std::wstring& sPath, const std::wstring& sName)
+{
+	if (!m_Animation.IsCreated() || m_nFrameWritten == m_nFrame)
+		return false;
+
+	wchar_t szFrame[32];
+	swprintf(szFrame, 32, _T(".%04d.bmp"), m_nFrame);
+	std::wstring sImgFile(sPath.length() ? sPath + _T("\\") + sName + szFrame :
+		sName + szFrame);
+
+	CreateBitmap(sImgFile);
+	m_nFrameWritten = m_nFrame;
+
+	if (m_nFrame + 1 >= m_Animation.GetFrames())
+		return false;
+
+	StartFrame(m_nFrame + 1);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the sources of an animation frame and reset the result fields.
+
+	The source indices of the finished frame are the prediction for the new frame.
+	*/
+void SimImpl::StartFrame(int nFrame)
+{
+	m_Animation.Predict(m_IdxField, m_nCols, m_nRows);
+
+	m_nFrame = nFrame;
+	{
+		// Wait for the probe, it integrates on the sources of the old frame
+		au::AutoLock<CCriticalSection> lock(&m_SourceLock);
+		ReadSources(*m_pAnimConfig, nFrame);
+		if (m_pKernel.get())
+			m_pKernel.reset(ISourceKernel::Create(m_vpSrc, m_fHeight, m_eCpuLevel));
+
+		++m_nSourceVersion;
+	}
+
+	m_IdxField = -1;
+	m_LenField.Nullify();
+	m_fMaxTraceLen = 0;
+	m_LineMgr.Reset(m_nRows);
+	{
+		// Idle threads keep polling the straggler queue
+		au::AutoLock<CCriticalSection> lock(&m_StragglerLock);
+		m_vPending.assign(m_nRows, std::vector<SPendState>());
+		m_vStraggler.clear();
+		m_vStragglerBusy.clear();
+	}
+	m_nPass = 0;
+	m_bFillPass = false;
+
+	// The line cost measured in the previous frame is the estimate for this one
+	if (m_bCostSchedule && (int)m_vLineCost.size() == m_nRows)
+	{
+		m_vCostKnown.assign(m_nRows, true);
+		m_LineMgr.SortByCost(m_vLineCost);
+	}
+
+	TRACE(_T("Frame %d of %d\n"), m_nFrame + 1, m_Animation.GetFrames());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Fill in the predicted grid points of a line.
+
+	The prediction of a grid point is confirmed if the corners of its cell, calculated in
+	the first pass, went to the predicted source. Its trace length is interpolated from
+	the corners then. Grid points whose prediction is not confirmed are calculated.
+	*/
+void SimImpl::FillLine(int y)
+{
+	for (int x = 0; x < m_nCols; ++x)
+	{
+		const int nPred(m_Animation.GetPrediction(x, y));
+		if (nPred < 0)
+			continue;
+
+		int x0(0), y0(0), x1(0), y1(0);
+		m_Animation.QueryCell(x, y, x0, y0, x1, y1);
+		if (m_IdxField[y0][x0] == nPred && m_IdxField[y0][x1] == nPred &&
+			m_IdxField[y1][x0] == nPred && m_IdxField[y1][x1] == nPred)
+		{
+			const double fx((double)(x - x0) / (x1 - x0)),
+				fy((double)(y - y0) / (y1 - y0)),
+				len((1 - fy) * ((1 - fx) * m_LenField[y0][x0] + fx * m_LenField[y0][x1]) +
+					fy * ((1 - fx) * m_LenField[y1][x0] + fx * m_LenField[y1][x1]));
+			StoreResult(x, y, nPred, len);
+			continue;
+		}
+
+		SPendState s;
+		mu::vec2d_type start_pos(0, 0);
+		GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+		InitState(s, start_pos, mu::vec2d_type(0, 0), x, y);
+
+		bool bCaptured(false);
+		int closest_src(Integrate(s, m_nMaxSteps, nullptr, bCaptured));
+		StoreResult(x, y, closest_src, s.len);
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Store the result of a grid point and update the color normalization. */
+void SimImpl::StoreResult(int x, int y, int idx, double len)
+{
+	SetPixel(m_IdxField, m_LenField, x, y, idx, len);
 
 	// Place write access to members behind in the next scope:
 	if (len > m_fMaxTraceLen)
@@ -634,7 +2527,308 @@ int SimImpl::Calc(const mu::vec2d_type& start_pos,
 	}
 	else
 		m_bColorNormalize = false;
+}
 
-	return closest_src;
+//-------------------------------------------------------------------------------------------
+/** \brief Add the result of a grid point to the sample cache once it is final. */
+void SimImpl::CacheResult(const SPendState& s, int idx, bool bCaptured)
+{
+	if (!m_SampleCache.IsCreated() || (!bCaptured && s.steps < m_nMaxSteps))
+		return;
+
+	mu::vec2d_type start_pos(0, 0);
+	GridCoordToModel(s.x, s.y, start_pos[0], start_pos[1]);
+	m_SampleCache.Insert(start_pos, idx, s.len);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Hash of all parameters affecting the result of a grid point.
+
+	Used to discard sample caches and tiles written with different parameters. Colors and
+	the viewport are not part of the hash. The instruction set is, the kernels of different
+	levels may round differently.
+	*/
+unsigned long long SimImpl::GetConfigHash() const
+{
+	std::wstringstream ss;
+	ss.precision(17);
+	ss << m_eIntegrator << _T(" ") << m_ePrecision << _T(" ") << m_fTimeStep << _T(" ")
+		<< m_fMaxTimeStep << _T(" ") << m_fTolerance << _T(" ") << m_nMinSteps << _T(" ")
+		<< m_nMaxSteps << _T(" ") << m_fAbortVel << _T(" ") << m_fFriction << _T(" ")
+		<< m_fHeight << _T(" ") << m_fSubstepDist << _T(" ") << m_nSubsteps << _T(" ")
+		<< m_ForceField.GetRes() << _T(" ") << m_fFieldExact << _T(" ")
+		<< m_SourceTree.IsCreated() << _T(" ") << m_fTreeTheta << _T(" ") << m_nTreeLeaf << _T(" ")
+		<< GetKernelName() << _T(" ")
+		<< m_Symmetry.GetDescription() << _T(" ") << m_fSymmetryTol;
+
+	for (std::size_t i = 0; i < m_vpSrc.size(); ++i)
+	{
+		const ISource* pSrc(m_vpSrc[i]);
+		ss << _T(" ") << pSrc->GetType() << _T(" ") << pSrc->GetPos()[0] << _T(" ")
+			<< pSrc->GetPos()[1] << _T(" ") << pSrc->GetMult() << _T(" ") << pSrc->GetSize();
+	}
+
+	return HashString(ss.str());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Hash of the settings the speed of the integration depends on.
+
+	Configurations of the same class share the autotune results. The step limits and the
+	grid are not part of it, they change the amount of work but not the best settings.
+	*/
+unsigned long long SimImpl::GetPerfClass() const
+{
+	std::wstringstream ss;
+	ss << m_eIntegrator << _T(" ") << m_ePrecision << _T(" ") << m_vpSrc.size() << _T(" ")
+		<< m_SweepLanes.GetLanes() << _T(" ") << m_bChannels << _T(" ")
+		<< (m_ForceField.GetRes() ? _T("force field") : m_SourceTree.IsCreated() ? _T("source tree") : m_pKernel.get() ? m_pKernel->GetName() : _T("generic"));
+
+	return HashString(ss.str());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Key of a line in the tile cache.
+
+	The content of a line depends on the physics, the grid and the viewport. Colors, the
+	name of the configuration file and the thread count do not change it.
+	*/
+unsigned long long SimImpl::GetTileKey(int y) const
+{
+	// Increment if the way lines are calculated changes
+	const int TILE_VERSION = 2;
+
+	std::wstringstream ss;
+	ss.precision(17);
+	ss << TILE_VERSION << _T(" ") << GetConfigHash() << _T(" ") << m_nCols << _T(" ") << m_nRows << _T(" ")
+		<< m_fViewX << _T(" ") << m_fViewY << _T(" ") << m_fViewWidth << _T(" ") << m_fViewHeight << _T(" ")
+		<< y;
+
+	return HashString(ss.str());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Fill the fields with the lines found in the tile cache.
+
+	Only the missing lines are queued for calculation.
+	\return true if at least one line was found.
+	*/
+bool SimImpl::RestoreTiles()
+{
+	std::vector<int> vIdx(m_nCols), vMissing;
+	std::vector<double> vLen(m_nCols);
+
+	m_vTileLoaded.assign(m_nRows, false);
+	for (int y = 0; y < m_nRows; ++y)
+	{
+		if (!m_TileCache.Load(GetTileKey(y), &vIdx[0], &vLen[0], m_nCols))
+		{
+			vMissing.push_back(y);
+			continue;
+		}
+
+		for (int x = 0; x < m_nCols; ++x)
+		{
+			m_IdxField[y][x] = vIdx[x];
+			m_LenField[y][x] = vLen[x];
+			SetChannels(x, y, tmCACHED, 0, 0, mu::vec2d_type(0, 0));
+		}
+
+		m_vTileLoaded[y] = true;
+	}
+
+	// Symmetric images of the grid points are only written when the canonical grid point is
+	// calculated, a missing line may need grid points of a line that was found.
+	bool bUsable(vMissing.size() < (std::size_t)m_nRows);
+	if (bUsable && vMissing.size() && m_Symmetry.IsSymmetric())
+	{
+		TRACE(_T("Tile cache: incomplete tiles of a symmetric layout are discarded\n"));
+		bUsable = false;
+	}
+
+	if (!bUsable)
+	{
+		m_IdxField.Nullify();
+		m_LenField.Nullify();
+		ResizeChannelFields();
+		m_vTileLoaded.assign(m_nRows, false);
+		return false;
+	}
+
+	TRACE(_T("Tile cache: %d of %d lines found\n"), m_nRows - (int)vMissing.size(), m_nRows);
+
+	m_fMaxTraceLen = m_LenField.Max();
+	m_LineMgr.Reset(vMissing);
+
+	for (int y = 0; y < m_nRows; ++y)
+	{
+		if (m_vTileLoaded[y])
+			DrawSingleLine(y);
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Write the calculated lines to the tile cache and trim it to its size budget.
+
+	Called once the calculation is done. The statistics are appended to the file
+	[name].tiles.txt next to the bitmap.
+	*/
+void SimImpl::StoreTiles(const std::wstring& sPath, const std::wstring& sName)
+{
+	std::vector<int> vIdx(m_nCols);
+	std::vector<double> vLen(m_nCols);
+
+	for (int y = 0; y < m_nRows; ++y)
+	{
+		if (y < (int)m_vTileLoaded.size() && m_vTileLoaded[y])
+			continue;
+
+		for (int x = 0; x < m_nCols; ++x)
+		{
+			vIdx[x] = m_IdxField[y][x];
+			vLen[x] = m_LenField[y][x];
+		}
+
+		m_TileCache.Store(GetTileKey(y), &vIdx[0], &vLen[0], m_nCols);
+	}
+
+	m_bTilesStored = true;
+	m_TileCache.Evict();
+
+	const std::wstring sStats(m_TileCache.GetStats());
+	TRACE(_T("Tile cache: %s\n"), sStats.c_str());
+
+	std::wstring sFile(sPath.length() ? sPath + _T("\\") + sName + _T(".tiles.txt") :
+		sName + _T(".tiles.txt"));
+	std::wofstream ofs(sFile.c_str(), std::ios::out | std::ios::app);
+	ofs << sStats << std::endl;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief 64 bit FNV-1a hash of a string. */
+unsigned long long SimImpl::HashString(const std::wstring& sText)
+{
+	unsigned long long nHash(14695981039346656037ULL);
+	for (std::size_t i = 0; i < sText.length(); ++i)
+	{
+		nHash ^= (unsigned long long)sText[i];
+		nHash *= 1099511628211ULL;
+	}
+
+	return nHash;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Store the result of a grid point and all of its symmetric images. */
+void SimImpl::SetPixel(int_field_type& idxField, float_field_type& lenField, int x, int y, int idx, double len)
+{
+	idxField[y][x] = idx;
+	lenField[y][x] = len;
+
+	for (int i = 0; i < SymmetryMap::tfCOUNT; ++i)
+	{
+		int xm(0), ym(0);
+		SymmetryMap::ETrafo eTrafo((SymmetryMap::ETrafo)i);
+		if (!m_Symmetry.HasTrafo(eTrafo) || !m_Symmetry.MapPixel(eTrafo, x, y, xm, ym))
+			continue;
+
+		idxField[ym][xm] = (idx >= 0) ? m_Symmetry.MapSource(eTrafo, idx) : idx;
+		lenField[ym][xm] = len;
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Call a function for every result field, the channel fields may be empty. */
+template<typename TFunc>
+void SimImpl::ForEachField(TFunc func)
+{
+	func(m_IdxField);
+	func(m_LenField);
+	for (std::size_t i = 0; i < m_vLaneIdx.size(); ++i)
+	{
+		func(*m_vLaneIdx[i]);
+		func(*m_vLaneLen[i]);
+	}
+
+	func(m_StepField);
+	func(m_TermField);
+	func(m_TimeField);
+	func(m_EndXField);
+	func(m_EndYField);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Allocate the extra output channels, they are empty if EXTRA_CHANNELS is not set. */
+void SimImpl::ResizeChannelFields()
+{
+	const int nCols(m_bChannels ? m_nCols : 0),
+		nRows(m_bChannels ? m_nRows : 0);
+
+	m_StepField.Resize(nCols, nRows);
+	m_TermField.Resize(nCols, nRows);
+	m_TimeField.Resize(nCols, nRows);
+	m_EndXField.Resize(nCols, nRows);
+	m_EndYField.Resize(nCols, nRows);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Store the extra output channels of a grid point and its symmetric images. */
+void SimImpl::SetChannels(int x, int y, ETermination eTerm, int nSteps, double fTime, const mu::vec2d_type& pos)
+{
+	if (!m_bChannels)
+		return;
+
+	m_StepField[y][x] = nSteps;
+	m_TermField[y][x] = eTerm;
+	m_TimeField[y][x] = fTime;
+	m_EndXField[y][x] = pos[0];
+	m_EndYField[y][x] = pos[1];
+
+	for (int i = 0; i < SymmetryMap::tfCOUNT; ++i)
+	{
+		int xm(0), ym(0);
+		SymmetryMap::ETrafo eTrafo((SymmetryMap::ETrafo)i);
+		if (!m_Symmetry.HasTrafo(eTrafo) || !m_Symmetry.MapPixel(eTrafo, x, y, xm, ym))
+			continue;
+
+		// Symmetries are only used with the full viewport, they mirror at the field center
+		const bool bMirrorX(eTrafo == SymmetryMap::tfMIRROR_X || eTrafo == SymmetryMap::tfROT_180),
+			bMirrorY(eTrafo == SymmetryMap::tfMIRROR_Y || eTrafo == SymmetryMap::tfROT_180);
+
+		m_StepField[ym][xm] = nSteps;
+		m_TermField[ym][xm] = eTerm;
+		m_TimeField[ym][xm] = fTime;
+		m_EndXField[ym][xm] = (eTerm != tmCACHED && bMirrorX) ? m_fSimWidth - pos[0] : pos[0];
+		m_EndYField[ym][xm] = (eTerm != tmCACHED && bMirrorY) ? m_fSimHeight - pos[1] : pos[1];
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+void SimImpl::StoreChannels(const SPendState& s, bool bCaptured)
+{
+	if (!m_bChannels)
+		return;
+
+	ETermination eTerm(bCaptured ? tmCAPTURED : ((s.steps < m_nMaxSteps) ? tmPENDING : tmMAX_STEPS));
+	SetChannels(s.x, s.y, eTerm, s.ct, s.steps * m_fTimeStep, s.pos);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Allocate the result fields of the sweep lanes 1..N-1. */
+void SimImpl::ResizeLaneFields()
+{
+	utils::clear_cont_of_ptr(m_vLaneIdx);
+	utils::clear_cont_of_ptr(m_vLaneLen);
+
+	for (int l = 1; l < m_SweepLanes.GetLanes(); ++l)
+	{
+		m_vLaneIdx.push_back(new int_field_type());
+		m_vLaneLen.push_back(new float_field_type());
+		m_vLaneIdx.back()->Resize(m_nCols, m_nRows);
+		m_vLaneLen.back()->Resize(m_nCols, m_nRows);
+		*m_vLaneIdx.back() = -1;
+	}
 }
 
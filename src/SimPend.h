@@ -11,7 +11,17 @@
 #include "utils/muBlockMatrix.h"
 #include "muparser/muParser.h"
 #include "Source.h"
+#include "Symmetry.h"
+#include "ForceField.h"
+#include "SourceTree.h"
+#include "SourceKernel.h"
+#include "SweepLanes.h"
+#include "Animation.h"
+#include "SampleCache.h"
+#include "TileCache.h"
 #include "TaskMgr.h"
+#include "RuntimeMetrics.h"
+#include "TraceRecorder.h"
 
 
 //---------------------------------------------------------------------------------------
@@ -31,6 +41,55 @@ public:
     typedef std::vector< ISource* > source_buf_type;
     typedef std::vector< mu::vec2d_type > trace_buf_type;
 
+    enum EIntegrator
+    {
+        inBEEMAN,                   ///< Beeman scheme with fixed time step
+        inDOPRI5                    ///< Dormand-Prince 5(4) with adaptive step size
+    };
+
+    enum EPrecision
+    {
+        prDOUBLE,                   ///< Integration in double precision
+        prFLOAT                     ///< Integration in single precision
+    };
+
+    /** \brief Processors a worker thread may run on. */
+    enum EAffinity
+    {
+        afNONE,                     ///< Left to the scheduler, only the ideal processor is set
+        afNODE,                     ///< Any processor of the NUMA node of the worker
+        afCORE                      ///< A single logical processor
+    };
+
+    /** \brief Termination reason of a grid point, stored in the extra output channels. */
+    enum ETermination
+    {
+        tmNONE = 0,                 ///< Not calculated
+        tmCAPTURED,                 ///< Captured by a source
+        tmMAX_STEPS,                ///< MAX_STEPS reached without capture
+        tmPENDING,                  ///< Step limit of the current pass reached, resumed later
+        tmCACHED                    ///< Taken from the sample cache or the tile cache
+    };
+
+    /** \brief Integrator state of a single grid point.
+
+      Only the previous and the current acceleration of the Beeman scheme are stored, the
+      third buffer is overwritten in every step.
+      */
+    struct SPendState
+    {
+        mu::vec2d_type pos;         ///< Pendulum position
+        mu::vec2d_type vel;         ///< Pendulum velocity
+        mu::vec2d_type acc;         ///< Current acceleration (Beeman only)
+        mu::vec2d_type acc_p;       ///< Previous acceleration (Beeman only)
+        double len;                 ///< Trace length so far
+        double steps;               ///< Integrated time in units of DELTA_T
+        double dt;                  ///< Current step size
+        int ct;                     ///< Number of integration steps done
+        int x;                      ///< Grid column
+        int y;                      ///< Grid row
+    };
+
     SimImpl(CWndOpenGL *pWnd, const au::IniFile &iniFile);
     virtual ~SimImpl();
 
@@ -40,20 +99,54 @@ public:
     void WinCoordToModel(int x, int y, double &sim_x, double &sim_y) const;
     void GridCoordToModel(int x, int y, double &sim_x, double &sim_y) const;
     void ModelCoordToWin(double sim_x, double sim_y, int &x, int &y) const;
+    void QueryViewport(double &x0, double &y0, double &width, double &height) const;
+    void SetViewport(double x0, double y0, double width, double height);
 
     int GetThreadCount() const;
+    void SetThreadCount(int nThreads);
+    EAffinity GetAffinity() const;
+    int GetAutotuneSamples() const;
+    CpuDispatch::ELevel GetCpuLevel() const;
+    CpuDispatch::ELevel GetDetectedCpuLevel() const;
+    void SetCpuLevel(CpuDispatch::ELevel eLevel);
+    bool IsCpuLevelFixed() const;
+    bool UsesCpuDispatch() const;
+    unsigned long long GetPerfClass() const;
+    double GetMetricsInterval() const;
+    int GetTraceEvents() const;
     int GetPixSize() const;
     std::size_t GetSrcCount() const;
+    double EstimateCost() const;
+    std::wstring GetKernelName() const;
 
     void SetField(int cols, int rows);
-    int QueryNextLine(int &nLine);
+    bool NeedsCalc(int x, int y) const;
+    int QueryNextLine(int &nLine, int nNode = -1);
+    void SetNodeCount(int nNodes);
+    void BeginFieldPlacement();
+    void PlaceFieldLines(int nNode);
+    void EndFieldPlacement();
     void FlagAsDone(int hLine);
+    void ReportLineCost(int y, double fSteps);
     bool IsDone() const;
+    bool IsResumePass() const;
+    bool HasMorePasses() const;
 
     void InitFromFile(const au::IniFile &iniFile);
     void Restore(const std::wstring &sPath, const std::wstring &sName);
     int Calc(const mu::vec2d_type &start_pos, const mu::vec2d_type &start_vel = mu::vec2d_type(), trace_buf_type *pvTrace = nullptr);
+    bool Probe(const mu::vec2d_type &start_pos, trace_buf_type &vTrace, int &idx, const volatile bool &bCancel) const;
+    int CalcSteps(const mu::vec2d_type &start_pos, int &nSteps) const;
+    int CalcPixel(int x, int y, trace_buf_type *pvTrace = nullptr);
+    int CalcLanes(int x, int y, trace_buf_type *pvTrace = nullptr);
+    int ResumeLine(int y);
+    bool QueryStraggler(SPendState &s);
+    void ResumeStraggler(SPendState &s);
+    void FlagStragglerDone(int y);
+    bool FinishFrame(const std::wstring &sPath, const std::wstring &sName);
     const ISource* GetMagnet(std::size_t idx) const;
+    double CheckPrecision(int nSamples) const;
+    void RunPrecisionCheck(const std::wstring &sPath, const std::wstring &sName) const;
 
     void DumpToFile(const std::wstring &sPath, const std::wstring &sFile);
     void CreateBitmap(const std::wstring &sFile);
@@ -73,29 +166,126 @@ private:
     int m_nWinWidth;                ///< Width of the preview window
     int m_nWinHeight;               ///< Height of the Preview window
     int m_nThreads;                 ///< Create this many threads for the calculation 
+    EAffinity m_eAffinity;          ///< Pinning of the worker threads
+    int m_nNodes;                   ///< Number of NUMA nodes the lines are placed on, 1 if not placed
+    int m_nAutotuneSamples;         ///< Grid points per autotune candidate, 0 if not tuned
+    double m_fMetricsInterval;      ///< Seconds between runtime metric samples, 0 if disabled
+    int m_nTraceEvents;             ///< Capacity of the per thread trace buffers, 0 if not traced
     int m_nMinSteps;
     int m_nMaxSteps;
     int m_nBatchMode;
+    int m_nSubsteps;                ///< Number of sub steps per time step close to a source
+    int m_nPass;                    ///< Index of the current pass
+    int m_nPassSteps;               ///< Step limit of the current pass
+    int m_nFirstPassSteps;          ///< Step limit of the first pass
+    double m_fPassGrowth;           ///< Growth factor of the step limit per pass
+    int m_nStragglerSteps;          ///< Soft step budget per grid point, 0 if disabled
+    EIntegrator m_eIntegrator;      ///< The integration scheme
+    EPrecision m_ePrecision;        ///< Floating point precision of the integration
+    int m_nPrecisionCheck;          ///< Number of grid points for the precision check
 
     double m_fTimeStep;             ///< Integration size (timesteps)
+    double m_fMaxTimeStep;          ///< Upper limit of the adaptive step size
+    double m_fTolerance;            ///< Local error tolerance of the adaptive integrator
+    double m_fSubstepDist;          ///< Sub stepping distance in multiples of SIZE or PEND_HEIGHT
     double m_fAbortVel;             ///< Stop iteration if tracer speed drops below this value.
     double m_fFriction;             ///< Friction coefficient
     double m_fSimWidth;             ///< With of the simulation field
     double m_fSimHeight;            ///< Height of the simulation field
+    double m_fViewX;                ///< Left edge of the viewport in model coordinates
+    double m_fViewY;                ///< Bottom edge of the viewport in model coordinates
+    double m_fViewWidth;            ///< Width of the viewport, the grid covers the viewport
+    double m_fViewHeight;           ///< Height of the viewport
     double m_fHeight;               ///< Height of the Pendulum above the magnets
+    double m_fMultScale;            ///< Strength factor of the decaying sources (MULT sweep)
     double m_fMaxTraceLen;          ///< The maximum length of all traces calculated so far.
     mutable double m_fTraceLenBuf;  ///< I need this as a buffer for muParser; mutable because it doesn't break constness
     bool m_bColorNormalize;
 
     TaskMgr m_LineMgr;              ///< A class managing the line distribution among the threads.
+    bool m_bCostSchedule;           ///< Hand out the most expensive lines first
+    int m_nScheduleSamples;         ///< Size of the lattice sampled for the line cost
+    std::vector<double> m_vLineCost; ///< Estimated integration steps of each line
+    std::vector<bool> m_vCostKnown; ///< Line cost sampled or measured, the others are interpolated
+    SymmetryMap m_Symmetry;         ///< Symmetries of the source layout
+    double m_fSymmetryTol;          ///< Position tolerance of the symmetry detection
+    ForceField m_ForceField;        ///< Optional precomputed acceleration field of all sources
+    double m_fFieldExact;           ///< Distance to the sources below which the field is not interpolated
+    SourceTree m_SourceTree;        ///< Optional quadtree for the Barnes-Hut force evaluation
+    double m_fTreeTheta;            ///< Opening angle of the source tree
+    int m_nTreeLeaf;                ///< Maximum number of sources in a leaf of the source tree
+    std::auto_ptr<ISourceKernel> m_pKernel; ///< Kernel specialized on the source layout
+    SweepLanes m_SweepLanes;        ///< Parameter sweep lanes integrated in lockstep
+    Animation m_Animation;          ///< Keyframes and the prediction from the previous frame
+    SampleCache m_SampleCache;      ///< Optional persistent cache of calculated grid points
+    TileCache m_TileCache;          ///< Optional on-disk cache of calculated lines shared by all configurations
+    std::vector<bool> m_vTileLoaded; ///< Lines taken from the tile cache
+    bool m_bTilesStored;            ///< True once the lines of the calculation are in the tile cache
+    std::auto_ptr<au::IniFile> m_pAnimConfig; ///< Copy of the configuration, the sources are read again per frame
+    CpuDispatch::ELevel m_eCpuLevel; ///< Instruction set of the source kernel
+    CpuDispatch::ELevel m_eCpuDetected; ///< Best instruction set supported by the cpu
+    bool m_bCpuLevelFixed;          ///< Instruction set given by CPU_DISPATCH
+    int m_nFrame;                   ///< Index of the current animation frame
+    int m_nFrameWritten;            ///< Index of the last animation frame written to file
+    bool m_bFillPass;               ///< True while the predicted grid points of a frame are filled in
+    int m_nSourceVersion;           ///< Incremented whenever the sources or the kernel are replaced
     mu::Parser m_parser;            ///< Function parser for the color scaling functions
     source_buf_type m_vpSrc;        ///< Sources following columbs law
     int_field_type   m_IdxField;    ///< Result field for magnet indices
     float_field_type m_LenField;    ///< Result field for trace lengths
+    std::vector<int_field_type*> m_vLaneIdx;    ///< Magnet indices of the sweep lanes 1..N-1
+    std::vector<float_field_type*> m_vLaneLen;  ///< Trace lengths of the sweep lanes 1..N-1
+    bool m_bChannels;               ///< Store the extra output channels below
+    int_field_type m_StepField;     ///< Number of integration steps per grid point
+    int_field_type m_TermField;     ///< Termination reason per grid point (ETermination)
+    float_field_type m_TimeField;   ///< Simulated time until the termination
+    float_field_type m_EndXField;   ///< Final pendulum position, x component
+    float_field_type m_EndYField;   ///< Final pendulum position, y component
+    std::vector< std::vector<SPendState> > m_vPending; ///< Unresolved grid points per line
+    std::vector<SPendState> m_vStraggler;   ///< Grid points that exceeded the soft step budget
+    std::vector<int> m_vStragglerBusy;      ///< Lines of the stragglers currently calculated
+    mutable CCriticalSection m_StragglerLock;
+    mutable CCriticalSection m_SourceLock;  ///< Held by the probe while it integrates and when the sources are replaced
 
     SimImpl(const SimImpl &ref);
     SimImpl& operator=(const SimImpl &ref);
-    ISource* ReadSourceData(const std::wstring &sSection, const au::IniFile &iniFile);
+    ISource* ReadSourceData(const std::wstring &sSection, const au::IniFile &iniFile, int nFrame);
+    double ReadSourceValue(const std::wstring &sSection, const wchar_t *szKey, const au::IniFile &iniFile, int nFrame) const;
+    void ReadSources(const au::IniFile &iniFile, int nFrame);
+    void SetPixel(int_field_type &idxField, float_field_type &lenField, int x, int y, int idx, double len);
+    void ResizeLaneFields();
+    void ResizeChannelFields();
+    template<typename TFunc>
+    void ForEachField(TFunc func);
+    void SetChannels(int x, int y, ETermination eTerm, int nSteps, double fTime, const mu::vec2d_type &pos);
+    void StoreChannels(const SPendState &s, bool bCaptured);
+    void CreateBitmap(const std::wstring &sFile, const int_field_type &idxField, const float_field_type &lenField) const;
+    int FindClosestSource(const mu::vec2d_type &pos) const;
+    void QuerySourceAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc, bool &bCapture, double &fNear) const;
+    void QuerySourceAcc(const mu::vec2f_type &pos, mu::vec2f_type &acc, bool &bCapture, float &fNear) const;
+    void InitState(SPendState &s, const mu::vec2d_type &start_pos, const mu::vec2d_type &start_vel, int x, int y) const;
+    int Integrate(SPendState &s, int nMaxSteps, trace_buf_type *pvTrace, bool &bCaptured) const;
+    template<typename T>
+    int IntegrateBeeman(SPendState &s, int nMaxSteps, trace_buf_type *pvTrace, bool &bCaptured) const;
+    int IntegrateDopri(SPendState &s, int nMaxSteps, trace_buf_type *pvTrace, bool &bCaptured) const;
+    void IntegrateLanes(SPendState *vs, int *vIdx, trace_buf_type *pvTrace) const;
+    void StartNextPass();
+    void EstimateLineCost();
+    void InterpolateLineCost(int y0, int y1);
+    void StartFrame(int nFrame);
+    void FillLine(int y);
+    void CheckPassDone();
+    void QueryUnresolvedLines(std::vector<int> &vLines) const;
+    int GetSoftLimit(const SPendState &s) const;
+    void Defer(const SPendState &s, bool bCaptured);
+    void StoreResult(int x, int y, int idx, double len);
+    void CacheResult(const SPendState &s, int idx, bool bCaptured);
+    bool IsFullViewport() const;
+    unsigned long long GetConfigHash() const;
+    unsigned long long GetTileKey(int y) const;
+    bool RestoreTiles();
+    void StoreTiles(const std::wstring &sPath, const std::wstring &sName);
+    static unsigned long long HashString(const std::wstring &sText);
 };
 
 #endif // include guard
\ No newline at end of file
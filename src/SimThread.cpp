@@ -13,6 +13,7 @@
 #include "SimThread.h"
 #include "SimPend.h"
 #include "WndOpenGL.h"
+#include "Autotuner.h"
 
 
 //-------------------------------------------------------------------------------------------
@@ -25,6 +26,19 @@ SimThread::SimThread(CWndOpenGL *pWnd, const au::IniFile &iniFile)
 , m_vThreadTable()
 , m_hCloseEvent(nullptr)
 , m_bShowTraces(false)
+, m_pProbeThread(nullptr)
+, m_hProbeEvent(nullptr)
+, m_ProbeLock()
+, m_vProbePos(0, 0)
+, m_bProbePending(false)
+, m_bProbeCancel(false)
+, m_bProbeQuit(false)
+, m_vProbeTrace()
+, m_nProbeIdx(-1)
+, m_Metrics()
+, m_Trace()
+, m_nStarted(0)
+, m_Topology()
 {
     ASSERT(pWnd);
     pWnd->SetSim(this);
@@ -47,6 +61,8 @@ void SimThread::Finalize()
 {
     au::AutoLock<CCriticalSection> lock(&m_KillLock);
 
+    StopProbe();
+
     if (m_bRunning && m_vThreadTable.size() >= 0)
     {
         m_bRunning = false;
@@ -54,9 +70,20 @@ void SimThread::Finalize()
         Sleep(0);
 
         m_pSim->DumpToFile(GetPath(), GetName());
-        DWORD nThreads((DWORD)m_vThreadTable.size());
-        WaitForMultipleObjects(nThreads, &m_vThreadTable[0], TRUE, INFINITE);
-        m_vThreadTable.clear();
+        StopThreads();
+
+        // Final totals
+        if (m_pSim->GetMetricsInterval() > 0)
+        {
+            m_pWnd->KillTimer(CWndOpenGL::ID_METRICS_TIMER);
+            m_Metrics.Sample();
+        }
+
+        if (m_Trace.IsCreated())
+        {
+            TraceRecorder::Detach();
+            WriteTrace();
+        }
     } // if not running
 }
 
@@ -97,49 +124,355 @@ void SimThread::HandleMouseClick(int /*x*/, int /*y*/)
 }
 
 //-------------------------------------------------------------------------------------------
+/** \brief Request a probe at the mouse position.
+
+  The trajectory is calculated by the probe thread, a probe still in progress is abandoned.
+  */
 void SimThread::HandleMouseMove(int x, int y)
 {
-    if (m_bShowTraces)
+    if (m_bShowTraces || !m_pProbeThread)
         return;
 
-    CWndOpenGL::PaintLock lock(m_pWnd);
-
     // convert window client coordinates to physical position
     double width(0), height(0);
     m_pSim->WinCoordToModel(x, y, width, height);
-    m_pSim->DrawModel();
-    SimImpl::trace_buf_type vTrace;
-    int idx(m_pSim->Calc(mu::vec2d_type(width, height), mu::vec2d_type(0, 0), &vTrace));
 
-    if (idx >= 0)
-    {
-        const ISource *pSrc(m_pSim->GetMagnet(idx));
-        glColor3ub((GLubyte)pSrc->GetRed(), (GLubyte)pSrc->GetGreen(), (GLubyte)pSrc->GetBlue());
-    }
-    else
+    au::AutoLock<CCriticalSection> lock(&m_ProbeLock);
+    m_vProbePos = mu::vec2d_type(width, height);
+    m_bProbePending = true;
+    m_bProbeCancel = true;
+    SetEvent(m_hProbeEvent);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Draw the trajectory of the last finished probe, called by the UI thread. */
+void SimThread::HandleProbeDone()
+{
+    SimImpl::trace_buf_type vTrace;
+    int idx(-1);
     {
-        glColor3ub((GLubyte)255, (GLubyte)255, (GLubyte)255);
+        au::AutoLock<CCriticalSection> lock(&m_ProbeLock);
+        vTrace.swap(m_vProbeTrace);
+        idx = m_nProbeIdx;
     }
 
-    m_pWnd->DrawLineStrip(vTrace, 1);
+    if (vTrace.size() && !m_bShowTraces)
+        m_pSim->DrawTrace(vTrace, idx);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Keyboard commands, T writes the trace recorded so far. */
+void SimThread::HandleKey(int nKey)
+{
+    if (nKey == 'T' && m_Trace.IsCreated())
+        WriteTrace();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Sample the runtime metrics and show them in the window title, called by the UI thread. */
+void SimThread::HandleTimer()
+{
+    m_Metrics.Sample();
+    m_pWnd->SetStatusText(m_Metrics.GetSummary());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Zoom by a factor of two around the mouse position.
+
+  The new viewport is aligned to the grid of the current one, so the grid points of both
+  coincide and are reused from the sample cache.
+  */
+void SimThread::HandleMouseWheel(int x, int y, int nDelta)
+{
+    double px(0), py(0), x0(0), y0(0), w(0), h(0), fw(0), fh(0);
+    int nCols(0), nRows(0);
+    m_pSim->WinCoordToModel(x, y, px, py);
+    m_pSim->QueryViewport(x0, y0, w, h);
+    m_pSim->QuerySimGrid(nCols, nRows);
+    m_pSim->QuerySimDim(fw, fh);
+
+    const double fZoom((nDelta > 0) ? 0.5 : 2);
+
+    // Stop zooming in where double precision can no longer resolve the grid
+    if (fZoom < 1 && w * fZoom / nCols < fw * 1e-9)
+        return;
+
+    const double dx(w / nCols), dy(h / nRows);
+    ChangeViewport(x0 + mu::round((px - (px - x0) * fZoom - x0) / dx) * dx,
+                   y0 + mu::round((py - (py - y0) * fZoom - y0) / dy) * dy,
+                   w * fZoom,
+                   h * fZoom);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Center the viewport on the mouse position, aligned to the current grid. */
+void SimThread::HandleRightClick(int x, int y)
+{
+    double px(0), py(0), x0(0), y0(0), w(0), h(0);
+    int nCols(0), nRows(0);
+    m_pSim->WinCoordToModel(x, y, px, py);
+    m_pSim->QueryViewport(x0, y0, w, h);
+    m_pSim->QuerySimGrid(nCols, nRows);
+
+    const double dx(w / nCols), dy(h / nRows);
+    ChangeViewport(x0 + mu::round((px - w / 2 - x0) / dx) * dx,
+                   y0 + mu::round((py - h / 2 - y0) / dy) * dy,
+                   w,
+                   h);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Stop the worker threads, move the viewport and restart the calculation. */
+void SimThread::ChangeViewport(double x0, double y0, double width, double height)
+{
+    au::AutoLock<CCriticalSection> lock(&m_KillLock);
+    if (!m_bRunning)
+        return;
+
+    m_bRunning = false;
+    SetEvent(m_hCloseEvent);
+    StopThreads();
+
+    m_pSim->SetViewport(x0, y0, width, height);
+    m_pWnd->SetViewport(x0, y0, width, height);
+    m_pSim->DrawModel();
+
+    // The tile cache may hold all lines of the new viewport
+    if (m_pSim->IsDone())
+        m_pSim->DumpToFile(GetPath(), GetName());
+
+    m_bRunning = true;
+    StartThreads();
 }
 
 //-------------------------------------------------------------------------------------------
 void SimThread::Start()
 {
+    if (m_pSim->GetAffinity() != SimImpl::afNONE)
+        m_Topology.Discover();
+
+    // The kernel and instruction set in use, Autotune replaces it with the tuned settings
+    std::wstringstream ss;
+    ss << _T("Kernel: ") << m_pSim->GetKernelName() << _T(", cpu dispatch ")
+       << CpuDispatch::GetName(m_pSim->GetCpuLevel()) << _T(" (detected ")
+       << CpuDispatch::GetName(m_pSim->GetDetectedCpuLevel()) << _T(")");
+    m_pWnd->SetStatusText(ss.str());
+
+    Autotune();
+    StartTrace();
+    m_pSim->RunPrecisionCheck(GetPath(), GetName());
     m_pSim->Restore(GetPath(), GetName());
     m_pSim->DrawModel();
 
+    // A complete checkpoint or a full tile cache hit leaves no lines, no worker would
+    // finish the calculation
+    if (m_pSim->IsDone())
+    {
+        m_pSim->DumpToFile(GetPath(), GetName());
+        if (m_pSim->GetBatchMode())
+            m_pWnd->PostMessage(WM_CLOSE);
+    }
+
+    StartThreads();
+    StartProbe();
+    StartMetrics();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Sample the runtime metrics every METRICS_INTERVAL seconds.
+
+  The samples are written to [name].metrics.txt, the throughput and the time shares are
+  shown in the window title.
+  */
+void SimThread::StartMetrics()
+{
+    const double fInterval(m_pSim->GetMetricsInterval());
+    if (fInterval <= 0)
+        return;
+
+    m_Metrics.Open(GetPath() + GetName() + _T(".metrics.txt"));
+    m_pWnd->SetTimer(CWndOpenGL::ID_METRICS_TIMER, (fInterval < 0.001) ? 1 : (UINT)(fInterval * 1000), NULL);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Choose the thread count and the instruction set of the source kernel.
+
+  Only done if AUTOTUNE is set, THREADS and CPU_DISPATCH given in the configuration are
+  kept. The results are cached per host and configuration class in autotune.cache next to
+  the configuration, the chosen settings are shown in the window title.
+  */
+void SimThread::Autotune()
+{
+    const int nSamples(m_pSim->GetAutotuneSamples());
+    const bool bThreads(m_pSim->GetThreadCount() == -1),
+               bLevel(m_pSim->UsesCpuDispatch() && !m_pSim->IsCpuLevelFixed());
+    if (nSamples <= 0 || (!bThreads && !bLevel))
+        return;
+
+    Autotuner tuner;
+    tuner.Create(GetPath() + _T("autotune.cache"), m_pSim->GetPerfClass());
+
+    Autotuner::SSettings settings;
+    const bool bCached(tuner.Lookup(settings));
+    if (!bCached)
+    {
+        // Half of the cores, the cores and up to one thread per logical processor
+        CpuTopology topology;
+        topology.Discover();
+        const int nCores(topology.GetCoreCount()),
+                  nProc(topology.GetProcessorCount());
+        const int vCandidate[] = { nCores / 2, nCores, (nCores + nProc) / 2, nProc };
+
+        std::vector<int> vThreads;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (vCandidate[i] > 0 && (vThreads.empty() || vCandidate[i] > vThreads.back()))
+                vThreads.push_back(vCandidate[i]);
+        }
+
+        // The cache is shared with configurations of the same class, so all instruction
+        // sets are tried even if CPU_DISPATCH is given
+        std::vector<CpuDispatch::ELevel> vLevel;
+        if (m_pSim->UsesCpuDispatch())
+        {
+            for (int i = CpuDispatch::lvGENERIC; i <= CpuDispatch::Detect(); ++i)
+                vLevel.push_back((CpuDispatch::ELevel)i);
+        }
+        else
+            vLevel.push_back(m_pSim->GetCpuLevel());
+
+        settings = tuner.Calibrate(*m_pSim, nSamples, vThreads, vLevel);
+        tuner.Store(settings);
+    }
+
+    if (bThreads)
+        m_pSim->SetThreadCount(settings.nThreads);
+
+    if (bLevel)
+        m_pSim->SetCpuLevel(settings.eLevel);
+
+    std::wstringstream ss;
+    ss << _T("Autotune") << (bCached ? _T(" (cached)") : _T("")) << _T(": ")
+       << GetWorkerCount() << _T(" threads, ")
+       << CpuDispatch::GetName(m_pSim->GetCpuLevel()) << _T(" (detected ")
+       << CpuDispatch::GetName(m_pSim->GetDetectedCpuLevel()) << _T("), ")
+       << (long long)settings.fRate << _T(" px/s");
+
+    TRACE(_T("%s\n"), ss.str().c_str());
+    m_pWnd->SetStatusText(ss.str());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Record a timeline of the workers, the UI thread and the probe thread.
+
+  Only done if TRACE_EVENTS is set. The trace is written to [name].trace.json when the
+  window is closed or the T key is pressed.
+  */
+void SimThread::StartTrace()
+{
+    const int nEvents(m_pSim->GetTraceEvents());
+    if (nEvents <= 0)
+        return;
+
+    const int nWorkers(GetWorkerCount());
+    std::vector<std::wstring> vName;
+    for (int i = 0; i < nWorkers; ++i)
+        vName.push_back(_T("worker ") + std::to_wstring(i));
+
+    vName.push_back(_T("ui"));
+    vName.push_back(_T("probe"));
+
+    m_Trace.Create(vName, nEvents);
+    m_Trace.Attach(nWorkers);
+}
+
+//-------------------------------------------------------------------------------------------
+void SimThread::WriteTrace() const
+{
+    m_Trace.Write(GetPath() + GetName() + _T(".trace.json"));
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Number of worker threads, one per processor unless THREADS is set. */
+int SimThread::GetWorkerCount() const
+{
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return (m_pSim->GetThreadCount() == -1) ? (int)sysinfo.dwNumberOfProcessors : m_pSim->GetThreadCount();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Start the probe thread.
+
+  It runs at a higher priority than the workers so probes stay responsive during a render.
+  */
+void SimThread::StartProbe()
+{
+    m_bProbeQuit = false;
+    m_hProbeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    // Started suspended, a thread finishing before m_bAutoDelete is cleared would delete itself
+    CWinThread *pNewThread(AfxBeginThread(ProbeMain,
+        reinterpret_cast<LPVOID>(this),
+        THREAD_PRIORITY_ABOVE_NORMAL,
+        0,  // default stack size
+        CREATE_SUSPENDED,
+        NULL));
+    if (!pNewThread)
+        throw utils::wruntime_error(_T("Can't start the probe thread."));
+
+    pNewThread->m_bAutoDelete = FALSE;
+    m_pProbeThread = pNewThread;
+    pNewThread->ResumeThread();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Abandon the probe in progress and terminate the probe thread. */
+void SimThread::StopProbe()
+{
+    if (!m_pProbeThread)
+        return;
+
+    {
+        au::AutoLock<CCriticalSection> lock(&m_ProbeLock);
+        m_bProbeQuit = true;
+        m_bProbeCancel = true;
+        SetEvent(m_hProbeEvent);
+    }
+
+    WaitForSingleObject(m_pProbeThread->m_hThread, INFINITE);
+    delete m_pProbeThread;
+    m_pProbeThread = nullptr;
+    CloseHandle(m_hProbeEvent);
+    m_hProbeEvent = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------
+void SimThread::StartThreads()
+{
     CWinThread *pNewThread(nullptr);
 
     // get number of processors
     SYSTEM_INFO sysinfo;
     GetSystemInfo(&sysinfo);
     DWORD &nProc(sysinfo.dwNumberOfProcessors);
-    int nThreads((m_pSim->GetThreadCount() == -1) ? nProc : m_pSim->GetThreadCount());
+    int nThreads(GetWorkerCount());
 
-    // Create the worker threads
-    m_vThreadTable.resize(nThreads);
+    // The counters are kept when the workers are restarted for a new viewport
+    if (!m_Metrics.IsCreated())
+        m_Metrics.Create(nThreads);
+
+    m_nStarted = 0;
+
+    // Pinned workers prefer the lines in the memory of their node
+    const bool bPlaced(m_pSim->GetAffinity() != SimImpl::afNONE && m_Topology.GetNodeCount() > 1);
+    m_pSim->SetNodeCount(bPlaced ? m_Topology.GetNodeCount() : 1);
+    if (bPlaced)
+        PlaceFields();
+
+    // Create the worker threads, they are started suspended since a thread finishing
+    // before m_bAutoDelete is cleared would delete itself
+    m_vThreadTable.assign(nThreads, nullptr);
     m_hCloseEvent = CreateEvent(NULL, TRUE, FALSE, NULL); // "SIM_PEND_CLOSE");
     for (int i = 0; i < nThreads; ++i)
     {
@@ -147,24 +480,81 @@ void SimThread::Start()
             reinterpret_cast<LPVOID>(this),
             THREAD_PRIORITY_NORMAL,
             0,  // default stack size
-            0,  // start immediately
+            CREATE_SUSPENDED,
             NULL);
-        if (pNewThread)
+        if (!pNewThread)
+            continue;
+
+        pNewThread->m_bAutoDelete = FALSE;
+        m_vThreadTable[i] = pNewThread;
+
+        // Pinned workers set their affinity themselves once they know their index
+        if (m_pSim->GetAffinity() == SimImpl::afNONE)
         {
-            m_vThreadTable[i] = pNewThread->m_hThread;
-            pNewThread->m_bAutoDelete = FALSE;
+            DWORD dwErr(SetThreadIdealProcessor(pNewThread->m_hThread, i % nProc));
+            if (dwErr==-1)
+            {
+                std::wstringstream ss;
+                ss << _T("Can't set preferred processor for thread ") << i;
+//                throw utils::wruntime_error( ss.str().c_str() );
+            }
         }
 
-        DWORD dwErr(SetThreadIdealProcessor(pNewThread->m_hThread, i % nProc));
-        if (dwErr==-1)
-        {
-            std::wstringstream ss;
-            ss << _T("Can't set preferred processor for thread ") << i;
-//            throw utils::wruntime_error( ss.str().c_str() );
-         }
+        pNewThread->ResumeThread();
     } // for all threads to start
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Wait for the worker threads and free them.
+
+  The close event must be set, it is closed here.
+  */
+void SimThread::StopThreads()
+{
+    // WaitForMultipleObjects is limited to 64 handles
+    for (std::size_t i = 0; i < m_vThreadTable.size(); ++i)
+    {
+        if (!m_vThreadTable[i])
+            continue;
+
+        WaitForSingleObject(m_vThreadTable[i]->m_hThread, INFINITE);
+        delete m_vThreadTable[i];
+    }
+
+    m_vThreadTable.clear();
+    CloseHandle(m_hCloseEvent);
+    m_hCloseEvent = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Move the lines of the result fields into the memory of the node owning them.
+
+  The fields were initialized by the UI thread. It is pinned to each node in turn to copy
+  the lines of that node, so their pages are touched first on that node.
+  */
+void SimThread::PlaceFields()
+{
+    TraceRecorder::Scope trace(_T("place fields"));
+
+    HANDLE hThread(GetCurrentThread());
+    GROUP_AFFINITY affinity;
+    PROCESSOR_NUMBER ideal;
+    if (!GetThreadGroupAffinity(hThread, &affinity) || !GetThreadIdealProcessorEx(hThread, &ideal))
+        return;
+
+    m_pSim->BeginFieldPlacement();
+    for (int i = 0; i < m_Topology.GetNodeCount(); ++i)
+    {
+        m_Topology.PinToNode(hThread, i);
+        m_pSim->PlaceFieldLines(i);
+    }
+
+    m_pSim->EndFieldPlacement();
+
+    SetThreadGroupAffinity(hThread, &affinity, nullptr);
+    SetThreadIdealProcessorEx(hThread, &ideal, nullptr);
+}
+
 //-------------------------------------------------------------------------------------------
 UINT SimThread::ThreadMain(LPVOID lpParam)
 {
@@ -180,6 +570,23 @@ UINT SimThread::ThreadMain(LPVOID lpParam)
 
         SimImpl &sim(*(pSelf->m_pSim));
         SimImpl::trace_buf_type vTrace;
+        // Worker index, the slot of the metrics and the trace
+        const int nWorker(InterlockedIncrement(&pSelf->m_nStarted) - 1);
+        RuntimeMetrics::SCounters &stats(pSelf->m_Metrics.Attach(nWorker));
+        if (pSelf->m_Trace.IsCreated())
+            pSelf->m_Trace.Attach(nWorker);
+
+        // Pin the worker before it allocates its buffers
+        const int nWorkers((int)pSelf->m_vThreadTable.size());
+        int nNode(-1);
+        if (sim.GetAffinity() != SimImpl::afNONE)
+        {
+            pSelf->m_Topology.PinWorker(GetCurrentThread(), nWorker, nWorkers, sim.GetAffinity() == SimImpl::afCORE);
+            if (pSelf->m_Topology.GetNodeCount() > 1)
+                nNode = pSelf->m_Topology.GetWorkerNode(nWorker, nWorkers);
+        }
+
+        long long t0(0), t1(0);
 
         int nCols(0), nRows(0);
         int y(0),
@@ -191,36 +598,131 @@ UINT SimThread::ThreadMain(LPVOID lpParam)
         while (pSelf->m_bRunning)
         {
             // query line to process
+            SimImpl::SPendState straggler;
+            bool bIdle(false),
+                 bStraggler(false);
             {
+                t0 = RuntimeMetrics::Now();
                 au::AutoLock<CCriticalSection> lock(&DataLock);
-                hLine = sim.QueryNextLine(y);
+                t1 = RuntimeMetrics::Now();
+                stats.data_wait += t1 - t0;
+                TraceRecorder::Record(_T("data lock wait"), t0, t1);
+
+                hLine = sim.QueryNextLine(y, nNode);
                 if (y > (nCols - 1) || y < 0)
-                    break;
+                {
+                    // No lines left, continue with the deferred grid points
+                    bStraggler = sim.QueryStraggler(straggler);
+
+                    // Other threads may still work on the last lines of a pass,
+                    // animations continue with the next frame
+                    if (!bStraggler && sim.IsDone())
+                    {
+                        if (!sim.FinishFrame(pSelf->GetPath(), pSelf->GetName()))
+                            break;
+
+                        continue;
+                    }
+
+                    bIdle = !bStraggler;
+                }
             }
 
-            // Calculate a single trace
-            mu::vec2d_type start_pos(0, 0), start_vel(0, 0);
-            mu::ivec2d_type grid_pos(0, 0);
+            if (bIdle)
+            {
+                t0 = RuntimeMetrics::Now();
+                Sleep(10);
+                t1 = RuntimeMetrics::Now();
+                stats.idle += t1 - t0;
+                TraceRecorder::Record(_T("idle"), t0, t1);
+                continue;
+            }
 
-            SimImpl::trace_buf_type *pvTrace(NULL);
-            for (int x = 0; x < nCols && pSelf->m_bRunning; ++x)
+            if (bStraggler)
             {
-                sim.GridCoordToModel(x, y, start_pos[0], start_pos[1]);
+                t0 = RuntimeMetrics::Now();
+                sim.ResumeStraggler(straggler);
+                t1 = RuntimeMetrics::Now();
+                ++stats.pixels;
+                stats.busy += t1 - t0;
+                TraceRecorder::Record(_T("straggler"), t0, t1, straggler.y);
+
+                t0 = RuntimeMetrics::Now();
+                au::AutoLock<CCriticalSection> lock(&DataLock);
+                t1 = RuntimeMetrics::Now();
+                stats.data_wait += t1 - t0;
+                TraceRecorder::Record(_T("data lock wait"), t0, t1);
+
+                sim.FlagStragglerDone(straggler.y);
+                {
+                    TraceRecorder::Scope trace(_T("color"), straggler.y);
+                    sim.ScreenRefresh(straggler.y);
+                }
+                {
+                    TraceRecorder::Scope trace(_T("present"));
+                    sim.DrawModel();
+                }
+                stats.draw += RuntimeMetrics::Now() - t1;
+
+                if (sim.IsDone() && !sim.FinishFrame(pSelf->GetPath(), pSelf->GetName()) && sim.GetBatchMode())
+                {
+                    pSelf->m_pWnd->PostMessage(WM_CLOSE);
+                    break;
+                }
 
-                pvTrace = (pSelf->m_bShowTraces && (x % nTraceStep == 0)) ? &vTrace : NULL;
-                int idx(sim.Calc(start_pos, start_vel, &vTrace));
-                if (pvTrace)
-                    sim.DrawTrace(vTrace, idx);
-            } // for all points in the line
+                continue;
+            }
+
+            t0 = RuntimeMetrics::Now();
+            const long long nSteps(stats.steps);
+            const bool bResume(sim.IsResumePass());
+            if (bResume)
+            {
+                // Continue the unresolved grid points of the previous pass
+                stats.pixels += sim.ResumeLine(y);
+            }
+            else
+            {
+                // Calculate a single trace
+                SimImpl::trace_buf_type *pvTrace(NULL);
+                for (int x = 0; x < nCols && pSelf->m_bRunning; ++x)
+                {
+                    // symmetric images are filled in by their counterpart
+                    if (!sim.NeedsCalc(x, y))
+                        continue;
+
+                    pvTrace = (pSelf->m_bShowTraces && (x % nTraceStep == 0)) ? &vTrace : NULL;
+                    int idx(sim.CalcPixel(x, y, &vTrace));
+                    ++stats.pixels;
+                    if (pvTrace)
+                        sim.DrawTrace(vTrace, idx);
+                } // for all points in the line
+            }
+            t1 = RuntimeMetrics::Now();
+            stats.busy += t1 - t0;
+            TraceRecorder::Record(bResume ? _T("resume line") : _T("line"), t0, t1, y);
 
             if (pSelf->m_bRunning)
             {
+                t0 = RuntimeMetrics::Now();
                 au::AutoLock<CCriticalSection> lock(&DataLock);
-                sim.ScreenRefresh(y);  // Write line data to frame buffer
-                sim.DrawModel();       // Display data
+                t1 = RuntimeMetrics::Now();
+                stats.data_wait += t1 - t0;
+                TraceRecorder::Record(_T("data lock wait"), t0, t1);
+
+                {
+                    TraceRecorder::Scope trace(_T("color"), y);
+                    sim.ScreenRefresh(y);  // Write line data to frame buffer
+                }
+                {
+                    TraceRecorder::Scope trace(_T("present"));
+                    sim.DrawModel();       // Display data
+                }
+                sim.ReportLineCost(y, (double)(stats.steps - nSteps));
                 sim.FlagAsDone(hLine);
+                stats.draw += RuntimeMetrics::Now() - t1;
 
-                if (sim.IsDone() && sim.GetBatchMode())
+                if (sim.IsDone() && !sim.FinishFrame(pSelf->GetPath(), pSelf->GetName()) && sim.GetBatchMode())
                 {
                     // SendMessage would cause a deadlock
                     pSelf->m_pWnd->PostMessage(WM_CLOSE);
@@ -242,7 +744,76 @@ UINT SimThread::ThreadMain(LPVOID lpParam)
         AfxMessageBox(_T("unexpected exception: closing thread."));
     }
 
+    RuntimeMetrics::Detach();
+    TraceRecorder::Detach();
+
     // Wait for termination event
     WaitForSingleObject(pSelf->m_hCloseEvent, INFINITE);
     return 0;
 }
+
+//-------------------------------------------------------------------------------------------
+/** \brief Calculate the requested probes.
+
+  Only the latest request is calculated. Finished probes are handed over to the UI thread
+  which draws them, probes never write the result fields.
+  */
+UINT SimThread::ProbeMain(LPVOID lpParam)
+{
+    SimThread *pSelf(static_cast<SimThread*>(lpParam));
+    ASSERT(pSelf->m_pSim.get());
+
+    if (pSelf->m_Trace.IsCreated())
+        pSelf->m_Trace.Attach(pSelf->GetWorkerCount() + 1);
+
+    try
+    {
+        SimImpl::trace_buf_type vTrace;
+        vTrace.reserve(20000);
+
+        for (;;)
+        {
+            WaitForSingleObject(pSelf->m_hProbeEvent, INFINITE);
+
+            mu::vec2d_type pos(0, 0);
+            {
+                au::AutoLock<CCriticalSection> lock(&pSelf->m_ProbeLock);
+                if (pSelf->m_bProbeQuit)
+                    break;
+
+                if (!pSelf->m_bProbePending)
+                    continue;
+
+                pos = pSelf->m_vProbePos;
+                pSelf->m_bProbePending = false;
+                pSelf->m_bProbeCancel = false;
+            }
+
+            int idx(-1);
+            {
+                TraceRecorder::Scope trace(_T("probe"));
+                if (!pSelf->m_pSim->Probe(pos, vTrace, idx, pSelf->m_bProbeCancel))
+                    continue;
+            }
+
+            {
+                au::AutoLock<CCriticalSection> lock(&pSelf->m_ProbeLock);
+                pSelf->m_vProbeTrace.swap(vTrace);
+                pSelf->m_nProbeIdx = idx;
+            }
+
+            pSelf->m_pWnd->PostMessage(CWndOpenGL::WM_PROBE_DONE);
+        }
+    }
+    catch (utils::wruntime_error &e)
+    {
+        AfxMessageBox(e.message().c_str());
+    }
+    catch (std::exception &)
+    {
+        AfxMessageBox(_T("unexpected exception!"));
+    }
+
+    TraceRecorder::Detach();
+    return 0;
+}
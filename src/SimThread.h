@@ -15,6 +15,9 @@
 
 //---------------------------------------------------------------------------------------
 #include "SimPend.h"
+#include "RuntimeMetrics.h"
+#include "TraceRecorder.h"
+#include "CpuTopology.h"
 
 //---------------------------------------------------------------------------------------
 // Forward declarations
@@ -30,6 +33,11 @@ public:
     virtual void Start();
     virtual void HandleMouseClick(int x, int y); 
     virtual void HandleMouseMove(int x, int y); 
+    virtual void HandleMouseWheel(int x, int y, int nDelta);
+    virtual void HandleRightClick(int x, int y);
+    virtual void HandleProbeDone();
+    virtual void HandleTimer();
+    virtual void HandleKey(int nKey);
     virtual void Finalize();
     virtual void SetPath(const std::wstring &sName);
     virtual void SetName(const std::wstring &sName);
@@ -37,12 +45,13 @@ public:
     virtual const std::wstring& GetPath() const;
     const SimImpl* GetSim() const;
     static UINT ThreadMain(LPVOID lpParam);
+    static UINT ProbeMain(LPVOID lpParam);
 
 private:
     const std::auto_ptr<SimImpl> m_pSim;
     std::wstring m_sPath;
     std::wstring m_sName;
-    std::vector<HANDLE> m_vThreadTable;
+    std::vector<CWinThread*> m_vThreadTable;    ///< Worker threads, deleted by StopThreads
     HANDLE m_hCloseEvent;
 
     CWndOpenGL *m_pWnd;
@@ -50,6 +59,34 @@ private:
     volatile bool m_bRunning;
     bool m_bShowTraces;
 
+    // Interactive probe, newer requests supersede the one in progress
+    CWinThread *m_pProbeThread;
+    HANDLE m_hProbeEvent;           ///< Signaled when a probe is requested or the thread should quit
+    CCriticalSection m_ProbeLock;   ///< Protects the probe request and the probe result
+    mu::vec2d_type m_vProbePos;     ///< Start position of the requested probe
+    bool m_bProbePending;           ///< A probe request is waiting
+    volatile bool m_bProbeCancel;   ///< Abandon the probe in progress
+    volatile bool m_bProbeQuit;     ///< Terminate the probe thread
+    SimImpl::trace_buf_type m_vProbeTrace;  ///< Trajectory of the last finished probe
+    int m_nProbeIdx;                ///< Source index of the last finished probe
+
+    RuntimeMetrics m_Metrics;       ///< Time shares and throughput of the worker threads
+    TraceRecorder m_Trace;          ///< Timeline of the workers, the UI and the probe thread
+    volatile long m_nStarted;       ///< Worker threads started, hands out the worker indices
+    CpuTopology m_Topology;         ///< NUMA nodes and cores, only discovered if THREAD_AFFINITY is set
+
+    void StartThreads();
+    void StopThreads();
+    void PlaceFields();
+    void Autotune();
+    void StartProbe();
+    void StopProbe();
+    void StartMetrics();
+    void StartTrace();
+    void WriteTrace() const;
+    int GetWorkerCount() const;
+    void ChangeViewport(double x0, double y0, double width, double height);
+
     SimThread(const SimThread &ref);
     SimThread& operator=(const SimThread &ref);
 };
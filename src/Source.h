@@ -38,6 +38,7 @@ public:
 	int GetGreen() const { return m_src.g; };
 	int GetBlue()  const { return m_src.b; };
 	double GetSize() const { return m_src.size; };
+	double GetMult() const { return m_src.mult; };
 	EType GetType()  const { return m_src.type; };
 
 	const mu::vec2d_type& GetPos() const { return m_src.pos; };
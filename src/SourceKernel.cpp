@@ -0,0 +1,90 @@
+#include "stdafx.h"
+#include "SourceKernel.h"
+
+// Generic variant, compiled without /arch switch
+#define SOURCE_KERNEL_NS kernel_generic
+#include "SourceKernelImpl.h"
+#undef SOURCE_KERNEL_NS
+
+//-------------------------------------------------------------------------------------------
+// Variants in SourceKernelAVX2.cpp and SourceKernelAVX512.cpp
+namespace kernel_avx2
+{
+    ISourceKernel* Create(const SKernelSource *pSrc, int nSrc, double fHeight, int nLin, ISource::EType eMag, int nMag);
+}
+
+namespace kernel_avx512
+{
+    ISourceKernel* Create(const SKernelSource *pSrc, int nSrc, double fHeight, int nLin, ISource::EType eMag, int nMag);
+}
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the layout the kernel is specialized on, called by the kernel variants. */
+ISourceKernel::ISourceKernel(int nLin, ISource::EType eMag, int nMag)
+    :m_nLin(nLin)
+    ,m_eMag(eMag)
+    ,m_nMag(nMag)
+{}
+
+//-------------------------------------------------------------------------------------------
+ISourceKernel::~ISourceKernel()
+{}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Name of the source layout, e.g. "1 LINEAR + 3 INV_SQR". */
+std::wstring ISourceKernel::GetName() const
+{
+    static const wchar_t *szType[] = { _T("LINEAR"), _T("INV"), _T("INV_SQR"), _T("INV_QRT") };
+    return std::to_wstring(m_nLin) + _T(" LINEAR + ") + std::to_wstring(m_nMag) + _T(" ") + szType[m_eMag];
+}
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Create a kernel specialized on the given sources.
+    \param eLevel Instruction set of the kernel variant.
+    \return The kernel or nullptr if there is no specialization for this source layout.
+
+    Specializations exist for zero or one linear source plus three to five decaying
+    sources of the same type.
+    */
+ISourceKernel* ISourceKernel::Create(const std::vector<ISource*> &vpSrc, double fHeight, CpuDispatch::ELevel eLevel)
+{
+    int nLin(0), nMag(0);
+    ISource::EType eMag(ISource::tpLIN);
+    std::vector<SKernelSource> vSrc(vpSrc.size());
+    for (std::size_t i = 0; i < vpSrc.size(); ++i)
+    {
+        const ISource *pSrc(vpSrc[i]);
+        vSrc[i].x = pSrc->GetPos()[0];
+        vSrc[i].y = pSrc->GetPos()[1];
+        vSrc[i].mult = pSrc->GetMult();
+        vSrc[i].size = pSrc->GetSize();
+        vSrc[i].type = pSrc->GetType();
+
+        const ISource::EType eType(pSrc->GetType());
+        if (eType == ISource::tpLIN)
+        {
+            ++nLin;
+            continue;
+        }
+
+        // All decaying sources must have the same type
+        if (nMag && eType != eMag)
+            return nullptr;
+
+        eMag = eType;
+        ++nMag;
+    }
+
+    if (vSrc.empty())
+        return nullptr;
+
+    const int nSrc((int)vSrc.size());
+    switch (eLevel)
+    {
+    case CpuDispatch::lvAVX512: return kernel_avx512::Create(&vSrc[0], nSrc, fHeight, nLin, eMag, nMag);
+    case CpuDispatch::lvAVX2:   return kernel_avx2::Create(&vSrc[0], nSrc, fHeight, nLin, eMag, nMag);
+    default:                    return kernel_generic::Create(&vSrc[0], nSrc, fHeight, nLin, eMag, nMag);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SOURCE_KERNEL_H
+#define SOURCE_KERNEL_H
+
+#include <string>
+#include <vector>
+#include "utils/muVector.h"
+#include "Source.h"
+#include "CpuDispatch.h"
+
+//-------------------------------------------------------------------------------------------
+/** \brief Plain copy of a source for the kernel variants.
+
+  The variants must not call the inline members of ISource, see SourceKernelImpl.h.
+  */
+struct SKernelSource
+{
+    double x, y;            ///< Source position
+    double mult;            ///< Source strength
+    double size;            ///< Capture radius
+    ISource::EType type;    ///< Source type
+};
+
+//-------------------------------------------------------------------------------------------
+/** \brief Interface for source evaluation kernels specialized on a source layout.
+
+  The generic force evaluation calls the virtual ISource::QueryForce per source and step.
+  A kernel knows the number and types of the sources at compile time, stores them
+  in plain arrays and evaluates all of them with a single virtual call per step.
+  Kernels can be evaluated in double and in single precision. The kernels are compiled
+  once per instruction set (see SourceKernelImpl.h), Create picks the variant.
+  */
+class ISourceKernel
+{
+public:
+    static ISourceKernel* Create(const std::vector<ISource*> &vpSrc, double fHeight, CpuDispatch::ELevel eLevel);
+    virtual ~ISourceKernel();
+
+    /** \brief Compute the acceleration caused by all sources.
+        \param pos The pendulum position.
+        \param acc The acceleration is subtracted from this vector.
+        \param bCapture Set to true if the position is within the capture radius of a source.
+        \param fNear Receives the distance to the closest non linear source divided by the
+                     larger one of its capture radius and the pendulum height.
+        */
+    virtual void QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc, bool &bCapture, double &fNear) const = 0;
+    virtual void QueryAcc(const mu::vec2f_type &pos, mu::vec2f_type &acc, bool &bCapture, float &fNear) const = 0;
+    std::wstring GetName() const;
+
+protected:
+    ISourceKernel(int nLin, ISource::EType eMag, int nMag);
+
+private:
+    int m_nLin;                 ///< Number of linear sources
+    ISource::EType m_eMag;      ///< Type of the decaying sources
+    int m_nMag;                 ///< Number of decaying sources
+};
+
+#endif // include guard
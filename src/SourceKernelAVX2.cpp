@@ -0,0 +1,5 @@
+//-------------------------------------------------------------------------------------------
+// AVX2 and FMA variant of the source kernels. This file is compiled with /arch:AVX2, the
+// kernels must only be created if CpuDispatch reports support for the instruction set.
+#define SOURCE_KERNEL_NS kernel_avx2
+#include "SourceKernelImpl.h"
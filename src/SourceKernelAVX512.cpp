@@ -0,0 +1,5 @@
+//-------------------------------------------------------------------------------------------
+// AVX-512 (F, CD, BW, DQ, VL) variant of the source kernels. This file is compiled with /arch:AVX512, the
+// kernels must only be created if CpuDispatch reports support for the instruction set.
+#define SOURCE_KERNEL_NS kernel_avx512
+#include "SourceKernelImpl.h"
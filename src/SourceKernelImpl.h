@@ -0,0 +1,218 @@
+//-------------------------------------------------------------------------------------------
+// Source kernel implementation, included once per instruction set variant.
+//
+// Define SOURCE_KERNEL_NS to the namespace of the variant before including this file. The
+// including translation unit is compiled with the matching /arch switch (Release only).
+// Keep the code in here self contained: inline functions shared with other translation
+// units (mu::sqr, std::min, std::vector, the ISource getters, ...) could be merged by the
+// linker with a variant the CPU does not support. The sources are handed over as plain
+// SKernelSource records, the kernel name and everything else using the library is built
+// in SourceKernel.cpp. The variant translation units don't include stdafx.h. Trivial
+// accessors like mu::Vector::operator[] are always inlined.
+//-------------------------------------------------------------------------------------------
+
+#ifndef SOURCE_KERNEL_NS
+#error SOURCE_KERNEL_NS must be defined before including SourceKernelImpl.h
+#endif
+
+#include <math.h>
+#include <float.h>
+#include "SourceKernel.h"
+
+namespace SOURCE_KERNEL_NS
+{
+
+//-------------------------------------------------------------------------------------------
+// The float overload of std::sqrt is an inline function of the library
+inline double Sqrt(double v) { return ::sqrt(v); }
+inline float Sqrt(float v) { return ::sqrtf(v); }
+
+inline double MaxValue(double) { return DBL_MAX; }
+inline float MaxValue(float) { return FLT_MAX; }
+
+//-------------------------------------------------------------------------------------------
+/** \brief Force factor of a decaying source, the force is the factor times r.
+
+    Factor takes the source strength and the squared distance including the pendulum
+    height.
+    */
+template<ISource::EType TType>
+struct MagnetForce;
+
+template<>
+struct MagnetForce<ISource::tpINV>
+{
+    template<typename T>
+    static T Factor(T mult, T d2) { return mult / d2; }
+};
+
+template<>
+struct MagnetForce<ISource::tpINV_SQR>
+{
+    template<typename T>
+    static T Factor(T mult, T d2) { return mult / (d2 * Sqrt(d2)); }
+};
+
+template<>
+struct MagnetForce<ISource::tpINV_QRT>
+{
+    template<typename T>
+    static T Factor(T mult, T d2) { return mult / (d2 * d2); }
+};
+
+//-------------------------------------------------------------------------------------------
+/** \brief Kernel for NLin linear sources and NMag decaying sources of the same type.
+
+  The loops have a fixed trip count and are unrolled by the compiler. The force factors
+  use a single division per source instead of the power chains of the ISource classes.
+  */
+template<int NLin, ISource::EType TMag, int NMag>
+class SourceKernel : public ISourceKernel
+{
+public:
+    SourceKernel(const SKernelSource *pSrc, int nSrc, double fHeight)
+        :ISourceKernel(NLin, TMag, NMag)
+    {
+        Init(m_dbl, pSrc, nSrc, fHeight);
+        Init(m_flt, pSrc, nSrc, fHeight);
+    }
+
+    virtual void QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc, bool &bCapture, double &fNear) const
+    {
+        Eval(m_dbl, pos, acc, bCapture, fNear);
+    }
+
+    virtual void QueryAcc(const mu::vec2f_type &pos, mu::vec2f_type &acc, bool &bCapture, float &fNear) const
+    {
+        Eval(m_flt, pos, acc, bCapture, fNear);
+    }
+
+private:
+    template<typename T>
+    struct SSrc
+    {
+        T x, y;             ///< Source position
+        T mult;             ///< Source strength
+        T size2;            ///< Squared capture radius
+        T near_scale;       ///< Inverse of the larger one of size and height squared
+    };
+
+    template<typename T>
+    struct SBuf
+    {
+        SSrc<T> lin[NLin ? NLin : 1];   ///< Linear sources, arrays need at least one element
+        SSrc<T> mag[NMag];              ///< Decaying sources
+        T height2;                      ///< Squared pendulum height
+    };
+
+    SBuf<double> m_dbl;
+    SBuf<float> m_flt;
+
+    template<typename T>
+    static void Init(SBuf<T> &buf, const SKernelSource *pSrc, int nSrc, double fHeight)
+    {
+        int nLin(0), nMag(0);
+        const double height2(fHeight * fHeight);
+        buf.height2 = (T)height2;
+        for (int i = 0; i < nSrc; ++i)
+        {
+            const SKernelSource &desc(pSrc[i]);
+            const double size2(desc.size * desc.size);
+            SSrc<T> &src((desc.type == ISource::tpLIN) ? buf.lin[nLin++] : buf.mag[nMag++]);
+            src.x = (T)desc.x;
+            src.y = (T)desc.y;
+            src.mult = (T)desc.mult;
+            src.size2 = (T)size2;
+            src.near_scale = (T)(1.0 / ((size2 > height2) ? size2 : height2));
+        }
+    }
+
+    template<typename T>
+    static T Min(T a, T b)
+    {
+        return (b < a) ? b : a;
+    }
+
+    template<typename T>
+    static void Eval(const SBuf<T> &buf, const mu::Vector<T, 2> &pos, mu::Vector<T, 2> &acc, bool &bCapture, T &fNear)
+    {
+        T near2(MaxValue(T()));
+
+        for (int i = 0; i < NLin; ++i)
+        {
+            const SSrc<T> &src(buf.lin[i]);
+            const T rx(pos[0] - src.x),
+                    ry(pos[1] - src.y),
+                    planar2(rx * rx + ry * ry);
+
+            acc[0] -= src.mult * rx;
+            acc[1] -= src.mult * ry;
+            bCapture |= planar2 < src.size2;
+        }
+
+        for (int i = 0; i < NMag; ++i)
+        {
+            const SSrc<T> &src(buf.mag[i]);
+            const T rx(pos[0] - src.x),
+                    ry(pos[1] - src.y),
+                    planar2(rx * rx + ry * ry),
+                    f(MagnetForce<TMag>::Factor(src.mult, planar2 + buf.height2));
+
+            acc[0] -= f * rx;
+            acc[1] -= f * ry;
+            bCapture |= planar2 < src.size2;
+            near2 = Min(near2, planar2 * src.near_scale);
+        }
+
+        fNear = Sqrt(near2);
+    }
+};
+
+//-------------------------------------------------------------------------------------------
+namespace
+{
+    template<int NLin, ISource::EType TMag>
+    ISourceKernel* CreateKernel(const SKernelSource *pSrc, int nSrc, double fHeight, int nMag)
+    {
+        switch (nMag)
+        {
+        case 3: return new SourceKernel<NLin, TMag, 3>(pSrc, nSrc, fHeight);
+        case 4: return new SourceKernel<NLin, TMag, 4>(pSrc, nSrc, fHeight);
+        case 5: return new SourceKernel<NLin, TMag, 5>(pSrc, nSrc, fHeight);
+        default: return nullptr;
+        }
+    }
+
+    template<int NLin>
+    ISourceKernel* CreateKernel(const SKernelSource *pSrc, int nSrc, double fHeight, ISource::EType eMag, int nMag)
+    {
+        switch (eMag)
+        {
+        case ISource::tpINV:     return CreateKernel<NLin, ISource::tpINV>(pSrc, nSrc, fHeight, nMag);
+        case ISource::tpINV_SQR: return CreateKernel<NLin, ISource::tpINV_SQR>(pSrc, nSrc, fHeight, nMag);
+        case ISource::tpINV_QRT: return CreateKernel<NLin, ISource::tpINV_QRT>(pSrc, nSrc, fHeight, nMag);
+        default:                 return nullptr;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Create the kernel for a source layout.
+    \param pSrc The sources.
+    \param nSrc Number of sources.
+    \param nLin Number of linear sources.
+    \param eMag Type of the decaying sources.
+    \param nMag Number of decaying sources.
+    \return The kernel or nullptr if there is no specialization for this source layout.
+    */
+ISourceKernel* Create(const SKernelSource *pSrc, int nSrc, double fHeight, int nLin, ISource::EType eMag, int nMag)
+{
+    switch (nLin)
+    {
+    case 0:  return CreateKernel<0>(pSrc, nSrc, fHeight, eMag, nMag);
+    case 1:  return CreateKernel<1>(pSrc, nSrc, fHeight, eMag, nMag);
+    default: return nullptr;
+    }
+}
+
+} // namespace SOURCE_KERNEL_NS
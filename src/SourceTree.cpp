@@ -0,0 +1,270 @@
+#include "stdafx.h"
+#include "SourceTree.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "utils/muGeneric.h"
+#include "Source.h"
+
+#if defined(min) || defined(max)
+#undef min
+#undef max
+#endif
+
+
+//-------------------------------------------------------------------------------------------
+SourceTree::SourceTree()
+    :m_vpSrc()
+    ,m_vpLin()
+    ,m_vNodes()
+    ,m_fHeight(0)
+    ,m_fTheta(0)
+    ,m_nLeafSize(1)
+{}
+
+//-------------------------------------------------------------------------------------------
+SourceTree::~SourceTree()
+{}
+
+//-------------------------------------------------------------------------------------------
+bool SourceTree::IsCreated() const
+{
+    return !m_vNodes.empty() || !m_vpLin.empty();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Index of the node monopole a source contributes to, -1 for linear sources. */
+int SourceTree::GetKernel(const ISource *pSrc)
+{
+    switch (pSrc->GetType())
+    {
+    case ISource::tpINV:     return 0;
+    case ISource::tpINV_SQR: return 1;
+    case ISource::tpINV_QRT: return 2;
+    default:                 return -1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Sort the sources into the quadtree.
+    \param vpSrc The sources.
+    \param fHeight Height of the pendulum above the source plane.
+    \param fTheta Opening angle, smaller values are more accurate.
+    \param nLeafSize Maximum number of sources in a leaf node.
+    */
+void SourceTree::Create(const std::vector<ISource*> &vpSrc, double fHeight, double fTheta, int nLeafSize)
+{
+    m_fHeight = fHeight;
+    m_fTheta = fTheta;
+    m_nLeafSize = std::max(nLeafSize, 1);
+    m_vpSrc.clear();
+    m_vpLin.clear();
+    m_vNodes.clear();
+
+    double x0(0), y0(0), x1(0), y1(0);
+    for (std::size_t i = 0; i < vpSrc.size(); ++i)
+    {
+        const ISource *pSrc(vpSrc[i]);
+        if (GetKernel(pSrc) < 0)
+        {
+            m_vpLin.push_back(pSrc);
+            continue;
+        }
+
+        const double x(pSrc->GetPos()[0]), y(pSrc->GetPos()[1]);
+        if (m_vpSrc.empty())
+        {
+            x0 = x1 = x;
+            y0 = y1 = y;
+        }
+
+        x0 = std::min(x0, x);
+        x1 = std::max(x1, x);
+        y0 = std::min(y0, y);
+        y1 = std::max(y1, y);
+        m_vpSrc.push_back(pSrc);
+    }
+
+    if (m_vpSrc.empty())
+        return;
+
+    const double half(0.5 * std::max(std::max(x1 - x0, y1 - y0), 1e-6));
+    Build(0, (int)m_vpSrc.size(), 0.5 * (x0 + x1), 0.5 * (y0 + y1), half, 0);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Create the node for a range of sources and its children recursively.
+    \return The index of the new node.
+    */
+int SourceTree::Build(int first, int last, double cx, double cy, double half, int depth)
+{
+    const int nIdx((int)m_vNodes.size());
+    m_vNodes.push_back(SNode());
+
+    SNode node;
+    node.cx = cx;
+    node.cy = cy;
+    node.half = half;
+    node.max_size = 0;
+    node.first = first;
+    node.last = last;
+    for (int i = 0; i < 4; ++i)
+        node.child[i] = -1;
+
+    // Monopoles; the centers are weighted with the absolute strength so that sources of
+    // opposite sign don't move the center out of the node.
+    double weight[NUM_KERNEL];
+    for (int k = 0; k < NUM_KERNEL; ++k)
+    {
+        node.mult[k] = node.pos[k][0] = node.pos[k][1] = weight[k] = 0;
+    }
+
+    for (int i = first; i < last; ++i)
+    {
+        const ISource *pSrc(m_vpSrc[i]);
+        const int k(GetKernel(pSrc));
+        const double w(std::fabs(pSrc->GetMult()));
+        node.mult[k] += pSrc->GetMult();
+        node.pos[k][0] += w * pSrc->GetPos()[0];
+        node.pos[k][1] += w * pSrc->GetPos()[1];
+        node.max_size = std::max(node.max_size, pSrc->GetSize());
+        weight[k] += w;
+    }
+
+    for (int k = 0; k < NUM_KERNEL; ++k)
+    {
+        if (weight[k] > 0)
+        {
+            node.pos[k][0] /= weight[k];
+            node.pos[k][1] /= weight[k];
+        }
+    }
+
+    // Split into quadrants
+    if (last - first > m_nLeafSize && depth < MAX_DEPTH)
+    {
+        const ISource** pBegin(&m_vpSrc[0]);
+        auto left = [cx](const ISource *p) { return p->GetPos()[0] < cx; };
+        auto below = [cy](const ISource *p) { return p->GetPos()[1] < cy; };
+
+        const ISource** pMid(std::partition(pBegin + first, pBegin + last, below));
+        const ISource** pSplit[5] = { pBegin + first,
+                                      std::partition(pBegin + first, pMid, left),
+                                      pMid,
+                                      std::partition(pMid, pBegin + last, left),
+                                      pBegin + last };
+
+        const double h(0.5 * half);
+        const double ox[4] = { -h,  h, -h, h },
+                     oy[4] = { -h, -h,  h, h };
+        for (int i = 0; i < 4; ++i)
+        {
+            const int i0((int)(pSplit[i] - pBegin)), i1((int)(pSplit[i + 1] - pBegin));
+            if (i0 < i1)
+                node.child[i] = Build(i0, i1, cx + ox[i], cy + oy[i], h, depth + 1);
+        }
+    }
+
+    m_vNodes[nIdx] = node;
+    return nIdx;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Compute the acceleration caused by all sources.
+    \param pos The pendulum position.
+    \param acc The acceleration is subtracted from this vector.
+    \param bCapture Set to true if the position is within the capture radius of a source.
+    \param fNear Receives the distance to the closest exactly evaluated source divided by
+                 the larger one of its capture radius and the pendulum height. Linear
+                 sources are not included.
+    */
+void SourceTree::QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc, bool &bCapture, double &fNear) const
+{
+    using std::sqrt;
+    using mu::sqr;
+
+    const double h2(sqr(m_fHeight));
+    mu::vec2d_type r, force;
+    double near2(std::numeric_limits<double>::max());
+    bCapture = false;
+
+    for (std::size_t i = 0; i < m_vpLin.size(); ++i)
+    {
+        const ISource *pSrc(m_vpLin[i]);
+        r[0] = pos[0] - pSrc->GetPos()[0];
+        r[1] = pos[1] - pSrc->GetPos()[1];
+
+        const double dist2(sqr(r[0]) + sqr(r[1]));
+        pSrc->QueryForce(force, r, sqrt(dist2 + h2));
+        acc[0] -= force[0];
+        acc[1] -= force[1];
+        bCapture |= dist2 < sqr(pSrc->GetSize());
+    }
+
+    fNear = sqrt(near2);
+    if (m_vNodes.empty())
+        return;
+
+    // Depth first traversal; each level adds at most three nodes to the stack
+    int stack[4 * MAX_DEPTH + 4], nTop(0);
+    stack[nTop++] = 0;
+
+    while (nTop)
+    {
+        const SNode &node(m_vNodes[stack[--nTop]]);
+        const double dx(pos[0] - node.cx),
+                     dy(pos[1] - node.cy),
+                     margin(node.half + node.max_size);
+        const bool bNear(std::fabs(dx) < margin && std::fabs(dy) < margin),
+                   bLeaf(node.child[0] < 0 && node.child[1] < 0 && node.child[2] < 0 && node.child[3] < 0);
+
+        if (!bNear && sqr(2 * node.half) < sqr(m_fTheta) * (sqr(dx) + sqr(dy) + h2))
+        {
+            // Far enough away, use the monopoles of the node
+            for (int k = 0; k < NUM_KERNEL; ++k)
+            {
+                if (node.mult[k] == 0)
+                    continue;
+
+                r[0] = pos[0] - node.pos[k][0];
+                r[1] = pos[1] - node.pos[k][1];
+
+                // INV: 1/d^2; INV_SQR: 1/d^3; INV_QRT: 1/d^4
+                const double dist2(sqr(r[0]) + sqr(r[1]) + h2);
+                const double f((k == 0) ? node.mult[k] / dist2 :
+                               (k == 1) ? node.mult[k] / (dist2 * sqrt(dist2)) :
+                                          node.mult[k] / sqr(dist2));
+                acc[0] -= f * r[0];
+                acc[1] -= f * r[1];
+            }
+        }
+        else if (bLeaf)
+        {
+            for (int i = node.first; i < node.last; ++i)
+            {
+                const ISource *pSrc(m_vpSrc[i]);
+                r[0] = pos[0] - pSrc->GetPos()[0];
+                r[1] = pos[1] - pSrc->GetPos()[1];
+
+                const double dist2(sqr(r[0]) + sqr(r[1]));
+                pSrc->QueryForce(force, r, sqrt(dist2 + h2));
+                acc[0] -= force[0];
+                acc[1] -= force[1];
+                bCapture |= dist2 < sqr(pSrc->GetSize());
+                near2 = std::min(near2, dist2 / std::max(sqr(pSrc->GetSize()), h2));
+            }
+        }
+        else
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                if (node.child[i] >= 0)
+                    stack[nTop++] = node.child[i];
+            }
+        }
+    }
+
+    fNear = sqrt(near2);
+}
@@ -0,0 +1,63 @@
+#ifndef SOURCE_TREE_H
+#define SOURCE_TREE_H
+
+#include <vector>
+#include "utils/muVector.h"
+
+//-------------------------------------------------------------------------------------------
+// Forward declarations
+class ISource;
+
+//-------------------------------------------------------------------------------------------
+/** \brief Quadtree for the Barnes-Hut evaluation of large source arrays.
+
+  The INV, INV_SQR and INV_QRT sources are sorted into a quadtree. Each node stores the
+  monopole of its sources per source type. Nodes that appear under an angle smaller than
+  the opening angle are evaluated using the monopole, all others are opened. Nodes containing
+  the pendulum position within the capture radius of one of their sources are always
+  opened, so the capture check sees every source close by. Linear sources do not decay
+  and are always evaluated exactly.
+  */
+class SourceTree
+{
+public:
+    SourceTree();
+    ~SourceTree();
+
+    void Create(const std::vector<ISource*> &vpSrc, double fHeight, double fTheta, int nLeafSize);
+    bool IsCreated() const;
+    void QueryAcc(const mu::vec2d_type &pos, mu::vec2d_type &acc, bool &bCapture, double &fNear) const;
+
+private:
+    enum
+    {
+        MAX_DEPTH = 32,
+        NUM_KERNEL = 3      ///< Number of decaying source types (INV, INV_SQR, INV_QRT)
+    };
+
+    struct SNode
+    {
+        double cx, cy;                  ///< Center of the node box
+        double half;                    ///< Half width of the node box
+        double max_size;                ///< Largest capture radius of all sources in the node
+        double mult[NUM_KERNEL];        ///< Sum of source strengths per source type
+        double pos[NUM_KERNEL][2];      ///< Strength weighted center per source type
+        int child[4];                   ///< Child node indices, -1 if not present
+        int first, last;                ///< Range of the sources in m_vpSrc
+    };
+
+    std::vector<const ISource*> m_vpSrc;    ///< Decaying sources in tree order
+    std::vector<const ISource*> m_vpLin;    ///< Linear sources
+    std::vector<SNode> m_vNodes;
+    double m_fHeight;
+    double m_fTheta;
+    int m_nLeafSize;
+
+    int Build(int first, int last, double cx, double cy, double half, int depth);
+    static int GetKernel(const ISource *pSrc);
+
+    SourceTree(const SourceTree &ref);
+    SourceTree& operator=(const SourceTree &ref);
+};
+
+#endif // include guard
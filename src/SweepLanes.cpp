@@ -0,0 +1,265 @@
+#include "stdafx.h"
+#include "SweepLanes.h"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "Source.h"
+#include "utils/utWideExceptions.h"
+
+
+namespace
+{
+    //---------------------------------------------------------------------------------------
+    /** \brief Force factor of a source, the force is the factor times r. */
+    template<int TType>
+    inline double ForceFactor(double mult, double d2);
+
+    template<>
+    inline double ForceFactor<ISource::tpLIN>(double mult, double /*d2*/) { return mult; }
+
+    template<>
+    inline double ForceFactor<ISource::tpINV>(double mult, double d2) { return mult / d2; }
+
+    template<>
+    inline double ForceFactor<ISource::tpINV_SQR>(double mult, double d2) { return mult / (d2 * std::sqrt(d2)); }
+
+    template<>
+    inline double ForceFactor<ISource::tpINV_QRT>(double mult, double d2) { return mult / (d2 * d2); }
+}
+
+
+//-------------------------------------------------------------------------------------------
+SweepLanes::SweepLanes()
+    :m_vSrc()
+    ,m_vValues()
+    ,m_eParam(spFRICTION)
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------------------------------
+SweepLanes::~SweepLanes()
+{}
+
+//-------------------------------------------------------------------------------------------
+void SweepLanes::Reset()
+{
+    m_vSrc.clear();
+    m_vValues.clear();
+    m_Lanes.num = 0;
+
+    for (int i = 0; i < MAX_LANES; ++i)
+    {
+        m_Lanes.lane[i] = i;
+        m_Lanes.friction[i] = 0;
+        m_Lanes.height2[i] = 0;
+        m_Lanes.inv_height2[i] = 0;
+        m_Lanes.mult_scale[i] = 1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set up the lanes.
+    \param vpSrc The sources, the strength of the decaying sources is the one of lane 0.
+    \param eParam The swept parameter.
+    \param vValues Parameter value per lane. For spMULT the values are factors, the
+                   strength of lane i is scaled by vValues[i] / vValues[0].
+    \param fFriction Friction of all lanes unless the friction is swept.
+    \param fHeight Pendulum height of all lanes unless the height is swept.
+    */
+void SweepLanes::Create(const std::vector<ISource*> &vpSrc,
+                        EParam eParam,
+                        const std::vector<double> &vValues,
+                        double fFriction,
+                        double fHeight)
+{
+    Reset();
+
+    if (vValues.empty() || vValues.size() > MAX_LANES)
+    {
+        std::wstringstream msg;
+        msg << _T("A parameter sweep needs between 1 and ") << (int)MAX_LANES << _T(" values.");
+        throw utils::wruntime_error(msg.str());
+    }
+
+    for (std::size_t i = 0; i < vValues.size(); ++i)
+    {
+        if (vValues[i] <= 0)
+            throw utils::wruntime_error(_T("Parameter sweep values must be greater then zero."));
+    }
+
+    m_eParam = eParam;
+    m_vValues = vValues;
+    m_Lanes.num = (int)vValues.size();
+
+    for (int i = 0; i < m_Lanes.num; ++i)
+    {
+        const double fVal(vValues[i]);
+        m_Lanes.friction[i] = (eParam == spFRICTION) ? fVal : fFriction;
+        m_Lanes.height2[i] = (eParam == spPEND_HEIGHT) ? fVal * fVal : fHeight * fHeight;
+        m_Lanes.inv_height2[i] = 1 / m_Lanes.height2[i];
+        m_Lanes.mult_scale[i] = (eParam == spMULT) ? fVal / vValues[0] : 1;
+    }
+
+    m_vSrc.resize(vpSrc.size());
+    for (std::size_t i = 0; i < vpSrc.size(); ++i)
+    {
+        const ISource *pSrc(vpSrc[i]);
+        SSrc &src(m_vSrc[i]);
+        src.x = pSrc->GetPos()[0];
+        src.y = pSrc->GetPos()[1];
+        src.mult = pSrc->GetMult();
+        src.size2 = pSrc->GetSize() * pSrc->GetSize();
+        src.inv_size2 = 1 / src.size2;
+        src.type = pSrc->GetType();
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+bool SweepLanes::IsCreated() const
+{
+    return m_Lanes.num > 0;
+}
+
+//-------------------------------------------------------------------------------------------
+int SweepLanes::GetLanes() const
+{
+    return m_Lanes.num;
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring SweepLanes::GetDescription() const
+{
+    static const wchar_t *szParam[] = { _T("FRICTION"), _T("PEND_HEIGHT"), _T("MULT") };
+
+    std::wstringstream ss;
+    ss << szParam[m_eParam] << _T(" =");
+    for (std::size_t i = 0; i < m_vValues.size(); ++i)
+        ss << _T(" ") << m_vValues[i];
+
+    return ss.str();
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Fill the slots with all lanes, slot i holds lane i. */
+void SweepLanes::InitSlots(SSlots &slots) const
+{
+    slots = m_Lanes;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Copy the lane parameters of slot nFrom to slot nTo. */
+void SweepLanes::MoveSlot(SSlots &slots, int nTo, int nFrom)
+{
+    slots.lane[nTo] = slots.lane[nFrom];
+    slots.friction[nTo] = slots.friction[nFrom];
+    slots.height2[nTo] = slots.height2[nFrom];
+    slots.inv_height2[nTo] = slots.inv_height2[nFrom];
+    slots.mult_scale[nTo] = slots.mult_scale[nFrom];
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Compute the acceleration of the used slots.
+    \param slots The lanes to evaluate.
+    \param px, py The pendulum position per slot.
+    \param ax, ay Receive the acceleration per slot, friction is not included.
+    \param bCapture Set to true for slots within the capture radius of a source.
+    \param fNear Receives the distance to the closest non linear source divided by the
+                 larger one of its capture radius and the pendulum height per slot.
+    */
+void SweepLanes::QueryAcc(const SSlots &slots,
+                          const double *px,
+                          const double *py,
+                          double *ax,
+                          double *ay,
+                          bool *bCapture,
+                          double *fNear) const
+{
+    // The capture check is kept as the smallest difference of the squared distance and
+    // the squared capture radius, a bool array would prevent the vectorization.
+    double cap[MAX_LANES], near2[MAX_LANES];
+    for (int l = 0; l < slots.num; ++l)
+    {
+        ax[l] = 0;
+        ay[l] = 0;
+        cap[l] = std::numeric_limits<double>::max();
+        near2[l] = std::numeric_limits<double>::max();
+    }
+
+    // The source type is resolved outside of the lane loop
+    for (std::size_t i = 0; i < m_vSrc.size(); ++i)
+    {
+        const SSrc &src(m_vSrc[i]);
+        switch (src.type)
+        {
+        case ISource::tpLIN:     Accumulate<ISource::tpLIN>(src, slots, px, py, ax, ay, cap, near2); break;
+        case ISource::tpINV:     Accumulate<ISource::tpINV>(src, slots, px, py, ax, ay, cap, near2); break;
+        case ISource::tpINV_SQR: Accumulate<ISource::tpINV_SQR>(src, slots, px, py, ax, ay, cap, near2); break;
+        case ISource::tpINV_QRT: Accumulate<ISource::tpINV_QRT>(src, slots, px, py, ax, ay, cap, near2); break;
+        }
+    }
+
+    for (int l = 0; l < slots.num; ++l)
+    {
+        bCapture[l] = cap[l] < 0;
+        fNear[l] = std::sqrt(near2[l]);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add the acceleration caused by a single source to the used slots. */
+template<int TType>
+void SweepLanes::Accumulate(const SSrc &src,
+                            const SSlots &slots,
+                            const double *px,
+                            const double *py,
+                            double *ax,
+                            double *ay,
+                            double *cap,
+                            double *near2) const
+{
+    // Local copies, the compiler can't tell that the output arrays don't alias the inputs
+    const int nLanes(slots.num);
+    const double sx(src.x),
+                 sy(src.y),
+                 src_mult(src.mult),
+                 size2(src.size2),
+                 inv_size2(src.inv_size2);
+    const double *mult_scale(slots.mult_scale),
+                 *height2(slots.height2),
+                 *inv_height2(slots.inv_height2);
+
+    for (int l = 0; l < nLanes; ++l)
+    {
+        const double rx(px[l] - sx),
+                     ry(py[l] - sy),
+                     planar2(rx * rx + ry * ry),
+                     mult((TType == ISource::tpLIN) ? src_mult : src_mult * mult_scale[l]),
+                     f(ForceFactor<TType>(mult, planar2 + height2[l]));
+
+        ax[l] -= f * rx;
+        ay[l] -= f * ry;
+        cap[l] = std::min(cap[l], planar2 - size2);
+
+        // 1 / max(size2, height2) without a division, the force of linear sources does
+        // not grow close to them
+        if (TType != ISource::tpLIN)
+            near2[l] = std::min(near2[l], planar2 * std::min(inv_size2, inv_height2[l]));
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Convert an upper case parameter name as used in the configuration file. */
+SweepLanes::EParam SweepLanes::FromName(const std::wstring &sName)
+{
+    if (sName == _T("FRICTION"))
+        return spFRICTION;
+    else if (sName == _T("PEND_HEIGHT"))
+        return spPEND_HEIGHT;
+    else if (sName == _T("MULT"))
+        return spMULT;
+    else
+        throw utils::wruntime_error(_T("Invalid sweep parameter (valid values are \"FRICTION\", \"PEND_HEIGHT\" or \"MULT\")."));
+}
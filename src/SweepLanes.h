@@ -0,0 +1,105 @@
+#ifndef SWEEP_LANES_H
+#define SWEEP_LANES_H
+
+#include <vector>
+#include <string>
+
+//-------------------------------------------------------------------------------------------
+// Forward declarations
+class ISource;
+
+//-------------------------------------------------------------------------------------------
+/** \brief Source evaluation for a parameter sweep.
+
+  A sweep integrates the same start position for up to MAX_LANES values of one simulation
+  parameter in lockstep. The lanes share the source geometry, the source loop is the outer
+  loop and the lane loop the inner one, so the compiler can vectorize across the lanes.
+
+  Lane 0 uses the configured parameters. The swept parameter is either the FRICTION, the
+  PEND_HEIGHT or a factor applied to the MULT of all decaying sources.
+  */
+class SweepLanes
+{
+public:
+    enum EParam
+    {
+        spFRICTION,         ///< Friction coefficient
+        spPEND_HEIGHT,      ///< Height of the pendulum above the sources
+        spMULT              ///< Factor on the strength of the decaying sources
+    };
+
+    enum
+    {
+        MAX_LANES = 8
+    };
+
+    /** \brief Lanes still being integrated.
+
+      Lanes that are done are removed by moving the last slot into their place, so the
+      source evaluation only covers the first num slots.
+      */
+    struct SSlots
+    {
+        int num;                        ///< Number of used slots
+        int lane[MAX_LANES];            ///< Lane index per slot
+        double friction[MAX_LANES];     ///< Friction per slot
+        double height2[MAX_LANES];      ///< Squared pendulum height per slot
+        double inv_height2[MAX_LANES];  ///< Inverse of the squared pendulum height per slot
+        double mult_scale[MAX_LANES];   ///< Strength factor of the decaying sources per slot
+    };
+
+    SweepLanes();
+    ~SweepLanes();
+
+    void Reset();
+    void Create(const std::vector<ISource*> &vpSrc,
+                EParam eParam,
+                const std::vector<double> &vValues,
+                double fFriction,
+                double fHeight);
+    bool IsCreated() const;
+    int GetLanes() const;
+    std::wstring GetDescription() const;
+
+    void InitSlots(SSlots &slots) const;
+    static void MoveSlot(SSlots &slots, int nTo, int nFrom);
+    void QueryAcc(const SSlots &slots,
+                  const double *px,
+                  const double *py,
+                  double *ax,
+                  double *ay,
+                  bool *bCapture,
+                  double *fNear) const;
+
+    static EParam FromName(const std::wstring &sName);
+
+private:
+    struct SSrc
+    {
+        double x, y;            ///< Source position
+        double mult;            ///< Source strength of lane 0
+        double size2;           ///< Squared capture radius
+        double inv_size2;       ///< Inverse of the squared capture radius
+        int type;               ///< ISource::EType
+    };
+
+    std::vector<SSrc> m_vSrc;
+    std::vector<double> m_vValues;      ///< The parameter value of each lane
+    EParam m_eParam;
+    SSlots m_Lanes;                     ///< Parameters of all lanes in lane order
+
+    template<int TType>
+    void Accumulate(const SSrc &src,
+                    const SSlots &slots,
+                    const double *px,
+                    const double *py,
+                    double *ax,
+                    double *ay,
+                    double *cap,
+                    double *near2) const;
+
+    SweepLanes(const SweepLanes &ref);
+    SweepLanes& operator=(const SweepLanes &ref);
+};
+
+#endif // include guard
@@ -0,0 +1,197 @@
+#include "stdafx.h"
+#include "Symmetry.h"
+
+#include <cmath>
+#include <sstream>
+
+#include "Source.h"
+
+
+//-------------------------------------------------------------------------------------------
+SymmetryMap::SymmetryMap()
+    :m_nCols(0)
+    ,m_nRows(0)
+{
+    Reset();
+}
+
+//-------------------------------------------------------------------------------------------
+SymmetryMap::~SymmetryMap()
+{}
+
+//-------------------------------------------------------------------------------------------
+void SymmetryMap::Reset()
+{
+    for (int i = 0; i < tfCOUNT; ++i)
+    {
+        m_bTrafo[i] = false;
+        m_vPerm[i].clear();
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Detect the symmetries of a source layout.
+    \param vpSrc The sources.
+    \param fSimWidth Width of the simulation field.
+    \param fSimHeight Height of the simulation field.
+    \param nCols Number of grid columns.
+    \param nRows Number of grid rows.
+    \param fTol Maximum position deviation of two sources considered to be identical.
+    */
+void SymmetryMap::Detect(const std::vector<ISource*> &vpSrc,
+                         double fSimWidth,
+                         double fSimHeight,
+                         int nCols,
+                         int nRows,
+                         double fTol)
+{
+    Reset();
+
+    m_nCols = nCols;
+    m_nRows = nRows;
+    if (vpSrc.empty())
+        return;
+
+    for (int i = 0; i < tfCOUNT; ++i)
+        m_bTrafo[i] = FindPermutation((ETrafo)i, vpSrc, fSimWidth, fSimHeight, fTol);
+
+    // Any two of the transformations generate the third one, make sure the set is closed
+    // even if the tolerance let one of them slip through.
+    for (int a = 0; a < tfCOUNT; ++a)
+    {
+        int b((a + 1) % tfCOUNT), c((a + 2) % tfCOUNT);
+        if (!m_bTrafo[a] || !m_bTrafo[b] || m_bTrafo[c])
+            continue;
+
+        m_vPerm[c].resize(vpSrc.size());
+        for (std::size_t i = 0; i < vpSrc.size(); ++i)
+            m_vPerm[c][i] = m_vPerm[b][m_vPerm[a][i]];
+
+        m_bTrafo[c] = true;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+bool SymmetryMap::FindPermutation(ETrafo eTrafo,
+                                  const std::vector<ISource*> &vpSrc,
+                                  double fSimWidth,
+                                  double fSimHeight,
+                                  double fTol)
+{
+    std::vector<int> &vPerm(m_vPerm[eTrafo]);
+    std::vector<bool> vUsed(vpSrc.size(), false);
+    vPerm.assign(vpSrc.size(), -1);
+
+    for (std::size_t i = 0; i < vpSrc.size(); ++i)
+    {
+        const ISource *pSrc(vpSrc[i]);
+        double x(pSrc->GetPos()[0]),
+               y(pSrc->GetPos()[1]);
+
+        if (eTrafo == tfMIRROR_X || eTrafo == tfROT_180)
+            x = fSimWidth - x;
+
+        if (eTrafo == tfMIRROR_Y || eTrafo == tfROT_180)
+            y = fSimHeight - y;
+
+        for (std::size_t j = 0; j < vpSrc.size(); ++j)
+        {
+            const ISource *pOther(vpSrc[j]);
+            if (vUsed[j] ||
+                pOther->GetType() != pSrc->GetType() ||
+                pOther->GetMult() != pSrc->GetMult() ||
+                pOther->GetSize() != pSrc->GetSize() ||
+                std::fabs(pOther->GetPos()[0] - x) > fTol ||
+                std::fabs(pOther->GetPos()[1] - y) > fTol)
+                continue;
+
+            vPerm[i] = (int)j;
+            vUsed[j] = true;
+            break;
+        }
+
+        if (vPerm[i] == -1)
+        {
+            vPerm.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+bool SymmetryMap::IsSymmetric() const
+{
+    for (int i = 0; i < tfCOUNT; ++i)
+    {
+        if (m_bTrafo[i])
+            return true;
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------
+bool SymmetryMap::HasTrafo(ETrafo eTrafo) const
+{
+    return m_bTrafo[eTrafo];
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Returns true if a grid point belongs to the fundamental domain.
+
+  A grid point is part of the fundamental domain if none of its images has a lower linear
+  index. Grid points whose images are outside the grid are always calculated.
+  */
+bool SymmetryMap::IsCanonical(int x, int y) const
+{
+    const int nIdx(y * m_nCols + x);
+    for (int i = 0; i < tfCOUNT; ++i)
+    {
+        int xm(0), ym(0);
+        if (m_bTrafo[i] && MapPixel((ETrafo)i, x, y, xm, ym) && (ym * m_nCols + xm) < nIdx)
+            return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Compute the image of a grid point.
+    \return false if the image is not on the grid.
+    */
+bool SymmetryMap::MapPixel(ETrafo eTrafo, int x, int y, int &xm, int &ym) const
+{
+    xm = (eTrafo == tfMIRROR_X || eTrafo == tfROT_180) ? m_nCols - x : x;
+    ym = (eTrafo == tfMIRROR_Y || eTrafo == tfROT_180) ? m_nRows - y : y;
+    return xm >= 0 && xm < m_nCols && ym >= 0 && ym < m_nRows;
+}
+
+//-------------------------------------------------------------------------------------------
+int SymmetryMap::MapSource(ETrafo eTrafo, int idx) const
+{
+    assert(m_bTrafo[eTrafo]);
+    assert(idx >= 0 && idx < (int)m_vPerm[eTrafo].size());
+    return m_vPerm[eTrafo][idx];
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring SymmetryMap::GetDescription() const
+{
+    static const wchar_t *szName[tfCOUNT] = { _T("mirror x"), _T("mirror y"), _T("rotation 180") };
+
+    std::wstringstream ss;
+    for (int i = 0; i < tfCOUNT; ++i)
+    {
+        if (!m_bTrafo[i])
+            continue;
+
+        if (ss.tellp() > 0)
+            ss << _T(", ");
+
+        ss << szName[i];
+    }
+
+    return IsSymmetric() ? ss.str() : std::wstring(_T("none"));
+}
@@ -0,0 +1,62 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include <vector>
+#include <string>
+
+//-------------------------------------------------------------------------------------------
+// Forward declarations
+class ISource;
+
+//-------------------------------------------------------------------------------------------
+/** \brief Symmetries of the source layout that map simulation grid points onto each other.
+
+  Only symmetries compatible with a cartesian grid are considered: mirroring at the vertical
+  and horizontal center axis and a rotation by 180 degrees around the field center. Two
+  source layouts are symmetric if each source has a mirrored partner of identical type,
+  strength and size. The partner may have a different color, the index permutation is
+  stored and used to fill the pixels outside the fundamental domain.
+  */
+class SymmetryMap
+{
+public:
+    enum ETrafo
+    {
+        tfMIRROR_X = 0,     ///< Mirror at the vertical center axis
+        tfMIRROR_Y,         ///< Mirror at the horizontal center axis
+        tfROT_180,          ///< Rotation by 180 degrees around the center
+        tfCOUNT
+    };
+
+    SymmetryMap();
+    ~SymmetryMap();
+
+    void Reset();
+    void Detect(const std::vector<ISource*> &vpSrc,
+                double fSimWidth,
+                double fSimHeight,
+                int nCols,
+                int nRows,
+                double fTol);
+
+    bool IsSymmetric() const;
+    bool HasTrafo(ETrafo eTrafo) const;
+    bool IsCanonical(int x, int y) const;
+    bool MapPixel(ETrafo eTrafo, int x, int y, int &xm, int &ym) const;
+    int MapSource(ETrafo eTrafo, int idx) const;
+    std::wstring GetDescription() const;
+
+private:
+    int m_nCols;
+    int m_nRows;
+    bool m_bTrafo[tfCOUNT];                 ///< Flags indicating which symmetries are present
+    std::vector<int> m_vPerm[tfCOUNT];      ///< Source index permutation for each symmetry
+
+    bool FindPermutation(ETrafo eTrafo,
+                         const std::vector<ISource*> &vpSrc,
+                         double fSimWidth,
+                         double fSimHeight,
+                         double fTol);
+};
+
+#endif // include guard
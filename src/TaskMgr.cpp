@@ -12,6 +12,7 @@
 TaskMgr::TaskMgr()
     :m_nNextIdx(0)
     ,m_vLinesToCalc()
+    ,m_vLineNode()
 {}
 
 //-------------------------------------------------------------------------------------------
@@ -29,14 +30,75 @@ void TaskMgr::Reset(int nLines)
     m_nNextIdx = 0;
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Queue a subset of lines for calculation. */
+void TaskMgr::Reset(const std::vector<int> &vLines)
+{
+    m_vLinesToCalc = vLines;
+    m_nNextIdx = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Hand out the lines waiting for calculation in the order of decreasing cost.
+    \param vCost Estimated cost of each line, indexed by the line number.
+
+  Lines already handed out keep their position, so the handles of lines in progress stay
+  valid. Lines of equal cost keep their order.
+  */
+void TaskMgr::SortByCost(const std::vector<double> &vCost)
+{
+    if (m_nNextIdx < 0 || m_nNextIdx >= (int)m_vLinesToCalc.size())
+        return;
+
+    auto cost = [&vCost](int nLine)
+    {
+        return (nLine >= 0 && nLine < (int)vCost.size()) ? vCost[nLine] : -1.0;
+    };
+
+    std::stable_sort(m_vLinesToCalc.begin() + m_nNextIdx,
+                     m_vLinesToCalc.end(),
+                     [&cost](int a, int b) { return cost(a) > cost(b); });
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Set the NUMA node holding the memory of each line.
+    \param vNode Node of each line indexed by the line number, empty to ignore the nodes.
+
+  The nodes are kept when the lines are reset.
+  */
+void TaskMgr::SetLineNodes(const std::vector<int> &vNode)
+{
+    m_vLineNode = vNode;
+}
+
 //-------------------------------------------------------------------------------------------
 /** \brief Return index of next line to calculate or -1 if no lines are left.
+    \param nLineIdx Receives the handle of the line.
+    \param nNode NUMA node of the calling thread or -1.
+
+  With a node the first waiting line in the memory of that node is handed out, the other
+  waiting lines keep their order. If there is none the next line is taken from another node.
 */
-int TaskMgr::GetNextLine(int &nLineIdx)
+int TaskMgr::GetNextLine(int &nLineIdx, int nNode)
 {
     if (m_nNextIdx < 0)
         return -1;
 
+    if (nNode >= 0 && m_vLineNode.size())
+    {
+        for (std::size_t i = m_nNextIdx; i < m_vLinesToCalc.size(); ++i)
+        {
+            const int nLine(m_vLinesToCalc[i]);
+            if (nLine < 0 || nLine >= (int)m_vLineNode.size() || m_vLineNode[nLine] != nNode)
+                continue;
+
+            std::rotate(m_vLinesToCalc.begin() + m_nNextIdx,
+                        m_vLinesToCalc.begin() + i,
+                        m_vLinesToCalc.begin() + i + 1);
+            break;
+        }
+    }
+
     nLineIdx = m_nNextIdx++;
     return (nLineIdx < (int)m_vLinesToCalc.size()) ? m_vLinesToCalc[nLineIdx] : -1;
 }
@@ -61,12 +123,27 @@ bool TaskMgr::IsDone() const
     using std::vector;
     using std::max_element;
 
+    if (m_vLinesToCalc.empty())
+        return true;
+
     vector<int>::const_iterator it(max_element(m_vLinesToCalc.begin(),
         m_vLinesToCalc.end()));
     int nMax(*it);
     return nMax == -1;
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Lines not flagged as calculated, including the lines in progress. */
+void TaskMgr::QueryWaitingLines(std::vector<int> &vLines) const
+{
+    vLines.clear();
+    for (std::size_t i = 0; i < m_vLinesToCalc.size(); ++i)
+    {
+        if (m_vLinesToCalc[i] >= 0)
+            vLines.push_back(m_vLinesToCalc[i]);
+    }
+}
+
 //-------------------------------------------------------------------------------------------
 void TaskMgr::SaveState(const std::wstring &sFile) const
 {
@@ -89,11 +166,9 @@ void TaskMgr::RestoreState(const std::wstring &sFile)
     ofs_pos.read((char*)(&m_vLinesToCalc[0]), (std::streamsize)(m_vLinesToCalc.size() * sizeof(int)));
     ofs_pos.close();
 
-    // Find out which line is the next one
+    // Find out which line is the next one, the queue may hold a subset of the lines
     std::sort(m_vLinesToCalc.begin(), m_vLinesToCalc.end(), std::less<int>());
-    for (int i = 0; i < (int)(m_vLinesToCalc.size() - 1) && m_vLinesToCalc[i] == -1; ++i)
-        m_nNextIdx = m_vLinesToCalc[i + 1];
-
-    if (m_nNextIdx < 0)
-        m_nNextIdx = (int)m_vLinesToCalc.size() - 1;
+    m_nNextIdx = 0;
+    while (m_nNextIdx < (int)m_vLinesToCalc.size() - 1 && m_vLinesToCalc[m_nNextIdx] == -1)
+        ++m_nNextIdx;
 }
@@ -13,16 +13,21 @@ public:
     ~TaskMgr();
 
     void Reset(int nLines);
-    int GetNextLine(int &nLineIdx);
+    void Reset(const std::vector<int> &vLines);
+    void SortByCost(const std::vector<double> &vCost);
+    void SetLineNodes(const std::vector<int> &vNode);
+    int GetNextLine(int &nLineIdx, int nNode = -1);
     int GetNumLinesDone() const;
     void FlagAsCalculated(int nLine);
     bool IsDone() const;
+    void QueryWaitingLines(std::vector<int> &vLines) const;
     void SaveState(const std::wstring &sFile) const;
     void RestoreState(const std::wstring &sFile);
 
 private:
     int m_nNextIdx;     ///< Total number of lines
     std::vector<int> m_vLinesToCalc;
+    std::vector<int> m_vLineNode;   ///< NUMA node holding the memory of each line, empty if not placed
 };
 
 #endif
\ No newline at end of file
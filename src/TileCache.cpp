@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "TileCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <sys/utime.h>
+
+#include "utils/utWideExceptions.h"
+
+
+namespace
+{
+    const unsigned int TILE_MAGIC = 0x31454C54;    // "TLE1"
+}
+
+
+//-------------------------------------------------------------------------------------------
+TileCache::TileCache()
+    :m_sDir()
+    ,m_nMaxBytes(0)
+    ,m_nBytes(0)
+    ,m_nHits(0)
+    ,m_nMisses(0)
+    ,m_nStored(0)
+    ,m_nEvicted(0)
+{}
+
+//-------------------------------------------------------------------------------------------
+TileCache::~TileCache()
+{}
+
+//-------------------------------------------------------------------------------------------
+void TileCache::Reset()
+{
+    m_sDir.clear();
+    m_nMaxBytes = 0;
+    m_nBytes = 0;
+    m_nHits = 0;
+    m_nMisses = 0;
+    m_nStored = 0;
+    m_nEvicted = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Use a cache directory, it is created if it does not exist.
+    \param nMaxBytes Size budget of the directory.
+    */
+void TileCache::Create(const std::wstring &sDir, unsigned long long nMaxBytes)
+{
+    Reset();
+
+    if (!sDir.length())
+        throw utils::wruntime_error(_T("No tile cache directory given."));
+
+    m_sDir = sDir;
+    if (m_sDir[m_sDir.length() - 1] != _T('\\'))
+        m_sDir += _T("\\");
+
+    m_nMaxBytes = nMaxBytes;
+    CreateDirectory(m_sDir.c_str(), NULL);
+}
+
+//-------------------------------------------------------------------------------------------
+bool TileCache::IsCreated() const
+{
+    return m_sDir.length() > 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Read a tile.
+    \return false if there is no tile with this key.
+    */
+bool TileCache::Load(unsigned long long nKey, int *pIdx, double *pLen, int nCols)
+{
+    const std::wstring sFile(GetFileName(nKey));
+    std::fstream file;
+    file.open(sFile.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+    {
+        ++m_nMisses;
+        return false;
+    }
+
+    unsigned int nMagic(0);
+    unsigned long long nFileKey(0);
+    int nFileCols(0);
+    file.read(reinterpret_cast<char*>(&nMagic), sizeof(nMagic));
+    file.read(reinterpret_cast<char*>(&nFileKey), sizeof(nFileKey));
+    file.read(reinterpret_cast<char*>(&nFileCols), sizeof(nFileCols));
+    if (file && nMagic == TILE_MAGIC && nFileKey == nKey && nFileCols == nCols)
+    {
+        file.read(reinterpret_cast<char*>(pIdx), static_cast<std::streamsize>(nCols * sizeof(int)));
+        file.read(reinterpret_cast<char*>(pLen), static_cast<std::streamsize>(nCols * sizeof(double)));
+    }
+    else
+        file.setstate(std::ios::failbit);
+
+    if (!file)
+    {
+        ++m_nMisses;
+        return false;
+    }
+
+    file.close();
+
+    // The modification time serves as the access time of the eviction
+    _wutime(sFile.c_str(), NULL);
+    ++m_nHits;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------
+void TileCache::Store(unsigned long long nKey, const int *pIdx, const double *pLen, int nCols)
+{
+    const std::wstring sFile(GetFileName(nKey));
+    std::fstream file;
+    file.open(sFile.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+        throw utils::wruntime_error(_T("Cant open file for tile output"));
+
+    file.write(reinterpret_cast<const char*>(&TILE_MAGIC), sizeof(TILE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&nKey), sizeof(nKey));
+    file.write(reinterpret_cast<const char*>(&nCols), sizeof(nCols));
+    file.write(reinterpret_cast<const char*>(pIdx), static_cast<std::streamsize>(nCols * sizeof(int)));
+    file.write(reinterpret_cast<const char*>(pLen), static_cast<std::streamsize>(nCols * sizeof(double)));
+    file.close();
+
+    ++m_nStored;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Delete the least recently used tiles until the directory fits the size budget. */
+void TileCache::Evict()
+{
+    struct STile
+    {
+        std::wstring sName;
+        unsigned long long nBytes;
+        unsigned long long nTime;
+    };
+
+    std::vector<STile> vTiles;
+    m_nBytes = 0;
+
+    WIN32_FIND_DATA data;
+    HANDLE hFind(FindFirstFile((m_sDir + _T("*.tile")).c_str(), &data));
+    if (hFind == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        STile tile;
+        tile.sName = data.cFileName;
+        tile.nBytes = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        tile.nTime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        m_nBytes += tile.nBytes;
+        vTiles.push_back(tile);
+    } while (FindNextFile(hFind, &data));
+
+    FindClose(hFind);
+
+    if (m_nBytes <= m_nMaxBytes)
+        return;
+
+    // Oldest first
+    std::sort(vTiles.begin(), vTiles.end(), [](const STile &a, const STile &b)
+    {
+        return a.nTime < b.nTime;
+    });
+
+    for (std::size_t i = 0; i < vTiles.size() && m_nBytes > m_nMaxBytes; ++i)
+    {
+        if (!DeleteFile((m_sDir + vTiles[i].sName).c_str()))
+            continue;
+
+        m_nBytes -= vTiles[i].nBytes;
+        ++m_nEvicted;
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring TileCache::GetStats() const
+{
+    std::wstringstream ss;
+    ss << _T("hits=") << m_nHits
+       << _T(" misses=") << m_nMisses
+       << _T(" stored=") << m_nStored
+       << _T(" evicted=") << m_nEvicted
+       << _T(" size_mb=") << (double)m_nBytes / (1024 * 1024)
+       << _T(" budget_mb=") << (double)m_nMaxBytes / (1024 * 1024);
+    return ss.str();
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring TileCache::GetFileName(unsigned long long nKey) const
+{
+    wchar_t szName[32];
+    swprintf(szName, 32, _T("%016llx.tile"), nKey);
+    return m_sDir + szName;
+}
@@ -0,0 +1,44 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <string>
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Content addressed on-disk cache of calculated grid lines.
+
+  A tile holds the source indices and trace lengths of one grid line. Tiles are stored in
+  a shared directory under the hash of everything affecting their content: the simulation
+  parameters, the sources, the grid size, the viewport and the line index. Runs of any
+  configuration file reuse the tiles of earlier runs with the same physics, regardless of
+  the file name, the color scheme, the window size or the thread count.
+
+  The directory is kept below a size budget by deleting the least recently used tiles.
+  */
+class TileCache
+{
+public:
+    TileCache();
+    ~TileCache();
+
+    void Reset();
+    void Create(const std::wstring &sDir, unsigned long long nMaxBytes);
+    bool IsCreated() const;
+    bool Load(unsigned long long nKey, int *pIdx, double *pLen, int nCols);
+    void Store(unsigned long long nKey, const int *pIdx, const double *pLen, int nCols);
+    void Evict();
+    std::wstring GetStats() const;
+
+private:
+    std::wstring m_sDir;            ///< Cache directory
+    unsigned long long m_nMaxBytes; ///< Size budget of the cache directory
+    unsigned long long m_nBytes;    ///< Size of the cache directory after the last eviction
+    int m_nHits;                    ///< Tiles found
+    int m_nMisses;                  ///< Tiles not found
+    int m_nStored;                  ///< Tiles written
+    int m_nEvicted;                 ///< Tiles deleted to stay within the budget
+
+    std::wstring GetFileName(unsigned long long nKey) const;
+};
+
+#endif // include guard
@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "TraceRecorder.h"
+
+#include <fstream>
+#include <iomanip>
+
+#include "utils/utWideExceptions.h"
+#include "RuntimeMetrics.h"
+
+
+namespace
+{
+    /** \brief Event buffer of the calling thread, null if the thread is not attached. */
+    thread_local void *g_pBuffer = nullptr;
+}
+
+
+//-------------------------------------------------------------------------------------------
+TraceRecorder::Scope::Scope(const wchar_t *szName, int nLine)
+    :m_szName(szName)
+    ,m_nLine(nLine)
+    ,m_nBegin(g_pBuffer ? RuntimeMetrics::Now() : 0)
+{}
+
+//-------------------------------------------------------------------------------------------
+TraceRecorder::Scope::~Scope()
+{
+    if (g_pBuffer)
+        Record(m_szName, m_nBegin, RuntimeMetrics::Now(), m_nLine);
+}
+
+//-------------------------------------------------------------------------------------------
+TraceRecorder::TraceRecorder()
+    :m_vBuf()
+    ,m_nStart(0)
+    ,m_fFreq(1)
+{
+    LARGE_INTEGER nFreq;
+    QueryPerformanceFrequency(&nFreq);
+    m_fFreq = (double)nFreq.QuadPart;
+}
+
+//-------------------------------------------------------------------------------------------
+TraceRecorder::~TraceRecorder()
+{}
+
+//-------------------------------------------------------------------------------------------
+void TraceRecorder::Reset()
+{
+    m_vBuf.clear();
+    m_nStart = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Allocate one event buffer per thread.
+    \param vThreadNames Names of the threads, the slot index is the position in this list.
+    \param nEvents Capacity of each buffer.
+    */
+void TraceRecorder::Create(const std::vector<std::wstring> &vThreadNames, int nEvents)
+{
+    if (nEvents <= 0)
+        throw utils::wruntime_error(_T("Number of trace events must be greater then zero."));
+
+    Reset();
+    m_vBuf.resize(vThreadNames.size());
+    for (std::size_t i = 0; i < m_vBuf.size(); ++i)
+    {
+        m_vBuf[i].sName = vThreadNames[i];
+        m_vBuf[i].vEvent.resize(nEvents);
+        m_vBuf[i].nCount = 0;
+        m_vBuf[i].nDropped = 0;
+    }
+
+    m_nStart = RuntimeMetrics::Now();
+}
+
+//-------------------------------------------------------------------------------------------
+bool TraceRecorder::IsCreated() const
+{
+    return m_vBuf.size() != 0;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Record the spans of the calling thread into a buffer.
+
+  A restarted thread may attach to the buffer of its predecessor, the events are appended.
+  */
+void TraceRecorder::Attach(int nSlot)
+{
+    ASSERT(nSlot >= 0 && nSlot < (int)m_vBuf.size());
+    g_pBuffer = &m_vBuf[nSlot];
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Stop recording the spans of the calling thread. */
+void TraceRecorder::Detach()
+{
+    g_pBuffer = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add a span to the buffer of the calling thread.
+    \param szName Name of the span, must be a string literal.
+    \param nBegin Performance counter at the start of the span.
+    \param nEnd Performance counter at the end of the span.
+    \param nLine Grid line the span belongs to or -1.
+    */
+void TraceRecorder::Record(const wchar_t *szName, long long nBegin, long long nEnd, int nLine)
+{
+    SBuffer *pBuf(static_cast<SBuffer*>(g_pBuffer));
+    if (!pBuf)
+        return;
+
+    const long n(pBuf->nCount);
+    if (n >= (long)pBuf->vEvent.size())
+    {
+        ++pBuf->nDropped;
+        return;
+    }
+
+    SEvent &e(pBuf->vEvent[n]);
+    e.name = szName;
+    e.begin = nBegin;
+    e.end = nEnd;
+    e.line = nLine;
+
+    // Publish the event after it is written
+    InterlockedExchange(&pBuf->nCount, n + 1);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Write all complete events in the Chrome trace event format. */
+void TraceRecorder::Write(const std::wstring &sFile) const
+{
+    std::wofstream ofs(sFile.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs)
+        throw utils::wruntime_error(_T("Can't open the trace file."));
+
+    const double fScale(1e6 / m_fFreq);    // ticks to microseconds
+    ofs << std::fixed << std::setprecision(3)
+        << _T("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (std::size_t i = 0; i < m_vBuf.size(); ++i)
+    {
+        const SBuffer &buf(m_vBuf[i]);
+
+        ofs << (i ? _T(",\n") : _T(""))
+            << _T("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":") << i
+            << _T(",\"args\":{\"name\":\"") << buf.sName << _T("\"}}");
+
+        const long nCount(buf.nCount);
+        for (long k = 0; k < nCount; ++k)
+        {
+            const SEvent &e(buf.vEvent[k]);
+            ofs << _T(",\n{\"name\":\"") << e.name
+                << _T("\",\"ph\":\"X\",\"pid\":1,\"tid\":") << i
+                << _T(",\"ts\":") << (e.begin - m_nStart) * fScale
+                << _T(",\"dur\":") << (e.end - e.begin) * fScale;
+
+            if (e.line >= 0)
+                ofs << _T(",\"args\":{\"line\":") << e.line << _T("}");
+
+            ofs << _T("}");
+        }
+
+        if (buf.nDropped)
+        {
+            ofs << _T(",\n{\"name\":\"events dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":") << i
+                << _T(",\"ts\":0,\"args\":{\"count\":") << buf.nDropped << _T("}}");
+        }
+    }
+
+    ofs << _T("\n]}\n");
+}
@@ -0,0 +1,76 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <vector>
+#include <string>
+
+
+//-------------------------------------------------------------------------------------------
+/** \brief Timeline of the work done by each thread in the Chrome trace event format.
+
+  Every thread attaches to a buffer of its own with room for a fixed number of events, so
+  recording takes neither a lock nor an allocation. Events beyond the capacity are counted
+  but dropped. A buffer publishes its event count after the event is complete, the trace
+  can be written while the threads are still running.
+
+  The written file can be opened in chrome://tracing or in the Perfetto UI. Threads that
+  are not attached record nothing, so the spans may be placed in code shared with the
+  benchmark or the batch queue.
+  */
+class TraceRecorder
+{
+public:
+    /** \brief Records a span from the construction to the destruction of the object. */
+    class Scope
+    {
+    public:
+        Scope(const wchar_t *szName, int nLine = -1);
+        ~Scope();
+
+    private:
+        const wchar_t *m_szName;
+        int m_nLine;
+        long long m_nBegin;
+
+        Scope(const Scope &ref);
+        Scope& operator=(const Scope &ref);
+    };
+
+    TraceRecorder();
+    ~TraceRecorder();
+
+    void Reset();
+    void Create(const std::vector<std::wstring> &vThreadNames, int nEvents);
+    bool IsCreated() const;
+    void Attach(int nSlot);
+    static void Detach();
+    static void Record(const wchar_t *szName, long long nBegin, long long nEnd, int nLine = -1);
+    void Write(const std::wstring &sFile) const;
+
+private:
+    struct SEvent
+    {
+        const wchar_t *name;    ///< Span name, must be a string literal
+        long long begin;        ///< Performance counter at the start of the span
+        long long end;          ///< Performance counter at the end of the span
+        int line;               ///< Grid line, -1 if the span is not related to a line
+    };
+
+    /** \brief Events of one thread, only the owning thread writes it. */
+    struct SBuffer
+    {
+        std::wstring sName;             ///< Thread name shown in the timeline
+        std::vector<SEvent> vEvent;     ///< Preallocated event storage
+        volatile long nCount;           ///< Number of complete events
+        long nDropped;                  ///< Events lost because the buffer was full
+    };
+
+    std::vector<SBuffer> m_vBuf;
+    long long m_nStart;     ///< Performance counter at the creation, the origin of the timeline
+    double m_fFreq;         ///< Performance counter ticks per second
+
+    TraceRecorder(const TraceRecorder &ref);
+    TraceRecorder& operator=(const TraceRecorder &ref);
+};
+
+#endif // include guard
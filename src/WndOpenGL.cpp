@@ -18,6 +18,11 @@
 
 LPCTSTR CWndOpenGL::m_lpszClassName = NULL;
 
+namespace
+{
+    const wchar_t *WND_TITLE = _T("Magnets and Pendulum Fractal");
+}
+
 //-------------------------------------------------------------------------------------------
 // COpenGLWin
 BEGIN_MESSAGE_MAP(CWndOpenGL, CWnd)
@@ -25,7 +30,12 @@ BEGIN_MESSAGE_MAP(CWndOpenGL, CWnd)
     ON_WM_PAINT()
     ON_WM_LBUTTONDOWN()
     ON_WM_MOUSEMOVE()
+    ON_WM_MOUSEWHEEL()
+    ON_WM_RBUTTONDOWN()
     ON_WM_CLOSE()
+    ON_MESSAGE(WM_PROBE_DONE, OnProbeDone)
+    ON_WM_TIMER()
+    ON_WM_KEYDOWN()
 END_MESSAGE_MAP()
 IMPLEMENT_DYNAMIC(CWndOpenGL, CWnd)
 
@@ -36,6 +46,8 @@ CWndOpenGL::CWndOpenGL()
     ,m_hRC(NULL)
     ,m_nCols(0)
     ,m_nRows(0)
+    ,m_fX0(0)
+    ,m_fY0(0)
     ,m_fWidth(0)
     ,m_fHeight(0)
     ,m_nWinWidth(0)
@@ -59,6 +71,27 @@ void CWndOpenGL::SetSim(SimThread *pSim)
     m_pSim = pSim;
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Set the part of the model shown in the window and clear the frame buffer. */
+void CWndOpenGL::SetViewport(double x0, double y0, double fWidth, double fHeight)
+{
+    au::AutoLock<CCriticalSection> lock(&m_ThreadLock);
+
+    m_fX0 = x0;
+    m_fY0 = y0;
+    m_fWidth = fWidth;
+    m_fHeight = fHeight;
+
+    if (!m_hWnd || !m_hRC)
+        return;
+
+    PaintLock paint(this);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(m_fX0, m_fX0 + m_fWidth, m_fY0, m_fY0 + m_fHeight, 0, 1);
+    InitFrameBuf();
+}
+
 //-------------------------------------------------------------------------------------------
 void CWndOpenGL::InitGL()
 {
@@ -83,7 +116,7 @@ void CWndOpenGL::InitGL()
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     //  glOrtho(0, m_nCols, 0, m_nRows, 0, 1);
-    glOrtho(0, m_fWidth, 0, m_fHeight, 0, 1);
+    glOrtho(m_fX0, m_fX0 + m_fWidth, m_fY0, m_fY0 + m_fHeight, 0, 1);
 }
 
 //---------------------------------------------------------------------------------------
@@ -114,7 +147,7 @@ BOOL CWndOpenGL::Create(DWORD dwExStyle,
     rc.SetRect(CPoint(0, 0), CPoint(m_nWinWidth, m_nWinHeight));
     BOOL bStat = CreateEx(dwExStyle,
         m_lpszClassName,
-        _T("Magnets and Pendulum Fractal"),
+        WND_TITLE,
         dwStyle,
         rc,
         pParentWnd,
@@ -241,13 +274,13 @@ void CWndOpenGL::DrawFrameBuf() const
 
     double zoom_x((double)m_nWinWidth / m_nCols),
         zoom_y((double)m_nWinHeight / m_nRows);
-    glRasterPos2i(0, 0);
+    glRasterPos2d(m_fX0, m_fY0);
     glPixelZoom((GLfloat)zoom_x, (GLfloat)zoom_y);
     glDrawPixels(m_nCols, m_nRows, GL_RGB, GL_UNSIGNED_BYTE, &m_vFieldData[0]);
 }
 
 //-------------------------------------------------------------------------------------------
-void CWndOpenGL::DrawCircle(int x, int y, double rad, int how, int steps) const
+void CWndOpenGL::DrawCircle(double x, double y, double rad, int how, int steps) const
 {
     au::AutoLock<CCriticalSection> lock(&m_ThreadLock);
 
@@ -272,7 +305,7 @@ void CWndOpenGL::DrawCircle(int x, int y, double rad, int how, int steps) const
 }
 
 //-------------------------------------------------------------------------------------------
-void CWndOpenGL::DrawCross(int x, int y, double size) const
+void CWndOpenGL::DrawCross(double x, double y, double size) const
 {
     au::AutoLock<CCriticalSection> lock(&m_ThreadLock);
 
@@ -327,6 +360,7 @@ void CWndOpenGL::EndGLPaint()
 //-------------------------------------------------------------------------------------------
 void CWndOpenGL::OnPaint()
 {
+    TraceRecorder::Scope trace(_T("swap"));
     au::AutoLock<CCriticalSection> lock(&m_ThreadLock);
 
     if (!m_hWnd)
@@ -463,9 +497,75 @@ void CWndOpenGL::OnMouseMove(UINT nFlags, CPoint point)
     CWnd::OnMouseMove(nFlags, point);
 }
 
+//-------------------------------------------------------------------------------------------
+/** \brief Zoom in or out around the mouse position. */
+BOOL CWndOpenGL::OnMouseWheel(UINT nFlags, short zDelta, CPoint point)
+{
+    if (!m_hWnd)
+        return FALSE;
+
+    // The wheel message comes with screen coordinates
+    ScreenToClient(&point);
+
+    CRect rect;
+    GetClientRect(&rect);
+    m_pSim->HandleMouseWheel(point.x, rect.Height() - point.y, zDelta);
+    return CWnd::OnMouseWheel(nFlags, zDelta, point);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Center the view on the mouse position. */
+void CWndOpenGL::OnRButtonDown(UINT nFlags, CPoint point)
+{
+    if (!m_hWnd)
+        return;
+
+    CRect rect;
+    GetClientRect(&rect);
+    m_pSim->HandleRightClick(point.x, rect.Height() - point.y);
+    CWnd::OnRButtonDown(nFlags, point);
+}
+
 //-------------------------------------------------------------------------------------------
 void CWndOpenGL::OnClose()
 {
     m_pSim->Finalize();
     CWnd::OnClose();
 }
+
+//-------------------------------------------------------------------------------------------
+LRESULT CWndOpenGL::OnProbeDone(WPARAM /*wParam*/, LPARAM /*lParam*/)
+{
+    if (m_hWnd)
+        m_pSim->HandleProbeDone();
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------
+void CWndOpenGL::OnTimer(UINT_PTR nIDEvent)
+{
+    if (nIDEvent == ID_METRICS_TIMER && m_pSim)
+        m_pSim->HandleTimer();
+    else
+        CWnd::OnTimer(nIDEvent);
+}
+
+//-------------------------------------------------------------------------------------------
+void CWndOpenGL::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
+{
+    if (m_pSim)
+        m_pSim->HandleKey((int)nChar);
+
+    CWnd::OnKeyDown(nChar, nRepCnt, nFlags);
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Show a status text in the window title, an empty text restores the plain title. */
+void CWndOpenGL::SetStatusText(const std::wstring &sText)
+{
+    if (!m_hWnd)
+        return;
+
+    SetWindowText(sText.length() ? (std::wstring(WND_TITLE) + _T(" - ") + sText).c_str() : WND_TITLE);
+}
@@ -2,6 +2,8 @@
 
 #include "utils/muGeneric.h"
 #include "utils/muVector.h"
+#include "RuntimeMetrics.h"
+#include "TraceRecorder.h"
 
 class SimThread;
 
@@ -20,7 +22,12 @@ public:
             :m_pLockObj(pLockObj)
             , m_bLockOwner(false)
         {
+            const long long t0(RuntimeMetrics::Now());
             m_pLockObj->m_ThreadLock.Lock();
+            const long long t1(RuntimeMetrics::Now());
+            RuntimeMetrics::AddPaintWait(t1 - t0);
+            TraceRecorder::Record(_T("paint lock wait"), t0, t1);
+
             if (m_pLockObj->m_bLocked == false)
             {
                 m_pLockObj->BeginGLPaint();
@@ -44,6 +51,18 @@ public:
         bool m_bLockOwner;
     };
 
+    /** \brief Posted by the probe thread when a probe trajectory is ready to draw. */
+    enum
+    {
+        WM_PROBE_DONE = WM_APP + 1
+    };
+
+    /** \brief Timer sampling the runtime metrics. */
+    enum
+    {
+        ID_METRICS_TIMER = 1
+    };
+
     static LPCTSTR m_lpszClassName;
 
     CWndOpenGL();
@@ -60,13 +79,15 @@ public:
         double fWidth,
         double fHeight);
     void SetSim(SimThread *pSim);
+    void SetViewport(double x0, double y0, double fWidth, double fHeight);
     void BeginGLPaint();
     void EndGLPaint();
-    void DrawCircle(int x, int y, double rad, int how = GL_TRIANGLE_FAN, int steps = 36) const;
-    void DrawCross(int x, int y, double size) const;
+    void DrawCircle(double x, double y, double rad, int how = GL_TRIANGLE_FAN, int steps = 36) const;
+    void DrawCross(double x, double y, double size) const;
     void DrawLineStrip(const std::vector<mu::vec2d_type> &vStrip, int width = 1) const;
     void DrawFrameBuf() const;
     void PutPixel(int x, int y, GLubyte r, GLubyte g, GLubyte b, int size = 1);
+    void SetStatusText(const std::wstring &sText);
 
 private:
     typedef std::vector<GLubyte> field_buf_type;
@@ -80,6 +101,8 @@ private:
     int m_nCols;        ///< Number of Columns
     int m_nRows;        ///< Number of Rows
 
+    double m_fX0;       ///< Left edge of the viewport in model coordinates
+    double m_fY0;       ///< Bottom edge of the viewport in model coordinates
     double m_fWidth;
     double m_fHeight;
 
@@ -99,7 +122,12 @@ private:
     afx_msg void OnPaint();
     afx_msg void OnLButtonDown(UINT nFlags, CPoint point);
     afx_msg void OnMouseMove(UINT nFlags, CPoint point);
+    afx_msg BOOL OnMouseWheel(UINT nFlags, short zDelta, CPoint point);
+    afx_msg void OnRButtonDown(UINT nFlags, CPoint point);
     afx_msg void OnClose();
+    afx_msg LRESULT OnProbeDone(WPARAM wParam, LPARAM lParam);
+    afx_msg void OnTimer(UINT_PTR nIDEvent);
+    afx_msg void OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
 };
 
 
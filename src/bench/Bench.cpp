@@ -0,0 +1,263 @@
+#include "stdafx.h"
+
+//--- Standard includes ---------------------------------------------------------------------
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//--- Utility classes -----------------------------------------------------------------------
+#include "utils/auIniFile.h"
+#include "utils/suUtility.h"
+#include "utils/utWideExceptions.h"
+
+//--- Simulation implementation -------------------------------------------------------------
+#include "SimPend.h"
+
+
+//-------------------------------------------------------------------------------------------
+//
+//  Benchmark of the trajectory integration
+//
+//  Every configuration is integrated for the same pseudo random sample of grid points,
+//  the results are comparable between program versions and kernel variants as long as
+//  the configuration, the sample size and the seed are the same.
+//
+//  usage: Bench [/json] [/samples:N] [/seed:N] [config.cfg | directory]...
+//
+//-------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------
+/** \brief Benchmark result of a single configuration. */
+struct SResult
+{
+    std::wstring sFile;             ///< Configuration file
+    std::wstring sKernel;           ///< Source evaluation used for the integration
+    std::wstring sCpuLevel;         ///< Instruction set of the source kernel
+    std::wstring sCpuDetected;      ///< Best instruction set of the cpu
+    int nPixels;                    ///< Number of integrated grid points
+    double fSeconds;                ///< Time spent in the integration
+    unsigned long long nSteps;      ///< Total number of integration steps
+    double fMeanSteps;              ///< Steps per grid point: mean
+    int nMinSteps;                  ///< Steps per grid point: minimum
+    int nMedSteps;                  ///< Steps per grid point: median
+    int nP90Steps;                  ///< Steps per grid point: 90th percentile
+    int nP99Steps;                  ///< Steps per grid point: 99th percentile
+    int nMaxSteps;                  ///< Steps per grid point: maximum
+    unsigned long long nChecksum;   ///< Hash of the source indices of all grid points
+};
+
+//-------------------------------------------------------------------------------------------
+/** \brief Add all configuration files (*.cfg) of a directory in alphabetical order. */
+void AddDirectory(const std::wstring &sDir, std::vector<std::wstring> &vFiles)
+{
+    std::wstring sBase(sDir);
+    if (sBase.length() && sBase[sBase.length() - 1] != _T('\\'))
+        sBase += _T("\\");
+
+    std::vector<std::wstring> vDirFiles;
+    WIN32_FIND_DATA data;
+    HANDLE hFind(FindFirstFile((sBase + _T("*.cfg")).c_str(), &data));
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                vDirFiles.push_back(sBase + data.cFileName);
+        } while (FindNextFile(hFind, &data));
+
+        FindClose(hFind);
+    }
+
+    std::sort(vDirFiles.begin(), vDirFiles.end());
+    vFiles.insert(vFiles.end(), vDirFiles.begin(), vDirFiles.end());
+}
+
+//-------------------------------------------------------------------------------------------
+/** \brief Integrate a seeded sample of grid points of a configuration. */
+SResult RunBenchmark(const std::wstring &sFile, int nSamples, unsigned nSeed)
+{
+    au::IniFile config;
+    config.Load(sFile, au::IniFile::eIGNORE_CASE);
+
+    SimImpl sim(nullptr, config);
+    int nCols(0), nRows(0);
+    sim.QuerySimGrid(nCols, nRows);
+
+    // mt19937 is fully specified by the standard, the sample is the same on every platform
+    std::mt19937 rng(nSeed);
+    std::vector<mu::vec2d_type> vPos(nSamples);
+    for (int i = 0; i < nSamples; ++i)
+    {
+        int x((int)(rng() % (unsigned)nCols)),
+            y((int)(rng() % (unsigned)nRows));
+        sim.GridCoordToModel(x, y, vPos[i][0], vPos[i][1]);
+    }
+
+    std::vector<int> vSteps(nSamples), vIdx(nSamples);
+    LARGE_INTEGER nFreq, nStart, nStop;
+    QueryPerformanceFrequency(&nFreq);
+    QueryPerformanceCounter(&nStart);
+
+    for (int i = 0; i < nSamples; ++i)
+        vIdx[i] = sim.CalcSteps(vPos[i], vSteps[i]);
+
+    QueryPerformanceCounter(&nStop);
+
+    SResult res;
+    res.sFile = sFile;
+    res.sKernel = sim.GetKernelName();
+    res.sCpuLevel = CpuDispatch::GetName(sim.GetCpuLevel());
+    res.sCpuDetected = CpuDispatch::GetName(sim.GetDetectedCpuLevel());
+    res.nPixels = nSamples;
+    res.fSeconds = (double)(nStop.QuadPart - nStart.QuadPart) / (double)nFreq.QuadPart;
+
+    // FNV-1a of the source indices
+    res.nChecksum = 14695981039346656037ULL;
+    res.nSteps = 0;
+    for (int i = 0; i < nSamples; ++i)
+    {
+        res.nChecksum ^= (unsigned long long)(unsigned)vIdx[i];
+        res.nChecksum *= 1099511628211ULL;
+        res.nSteps += vSteps[i];
+    }
+
+    std::sort(vSteps.begin(), vSteps.end());
+    res.fMeanSteps = (double)res.nSteps / nSamples;
+    res.nMinSteps = vSteps.front();
+    res.nMedSteps = vSteps[nSamples / 2];
+    res.nP90Steps = vSteps[(std::size_t)(nSamples * 0.9)];
+    res.nP99Steps = vSteps[(std::size_t)(nSamples * 0.99)];
+    res.nMaxSteps = vSteps.back();
+    return res;
+}
+
+//-------------------------------------------------------------------------------------------
+std::wstring JsonEscape(const std::wstring &sText)
+{
+    std::wstring sOut;
+    for (std::size_t i = 0; i < sText.length(); ++i)
+    {
+        if (sText[i] == _T('\\') || sText[i] == _T('"'))
+            sOut += _T('\\');
+
+        sOut += sText[i];
+    }
+
+    return sOut;
+}
+
+//-------------------------------------------------------------------------------------------
+void PrintText(const std::vector<SResult> &vRes)
+{
+    wprintf(_T("%-24ls %-32ls %-8ls %-8ls %8ls %12ls %14ls %9ls %7ls %7ls %7ls %7ls %7ls  %ls\n"),
+            _T("config"), _T("kernel"), _T("cpu"), _T("detected"), _T("pixels"), _T("pixels/s"), _T("steps/s"),
+            _T("mean"), _T("min"), _T("p50"), _T("p90"), _T("p99"), _T("max"), _T("checksum"));
+
+    for (std::size_t i = 0; i < vRes.size(); ++i)
+    {
+        const SResult &r(vRes[i]);
+        wprintf(_T("%-24ls %-32ls %-8ls %-8ls %8d %12.1f %14.4g %9.1f %7d %7d %7d %7d %7d  %016llx\n"),
+                r.sFile.c_str(), r.sKernel.c_str(), r.sCpuLevel.c_str(), r.sCpuDetected.c_str(), r.nPixels, r.nPixels / r.fSeconds, r.nSteps / r.fSeconds,
+                r.fMeanSteps, r.nMinSteps, r.nMedSteps, r.nP90Steps, r.nP99Steps, r.nMaxSteps, r.nChecksum);
+    }
+}
+
+//-------------------------------------------------------------------------------------------
+void PrintJson(const std::vector<SResult> &vRes, int nSamples, unsigned nSeed)
+{
+    wprintf(_T("{\n  \"samples\": %d,\n  \"seed\": %u,\n  \"results\": ["), nSamples, nSeed);
+    for (std::size_t i = 0; i < vRes.size(); ++i)
+    {
+        const SResult &r(vRes[i]);
+        wprintf(_T("%ls\n    {\"config\": \"%ls\", \"kernel\": \"%ls\", \"cpu_level\": \"%ls\", \"cpu_detected\": \"%ls\", ")
+                _T("\"pixels\": %d, \"seconds\": %.6f, ")
+                _T("\"pixels_per_s\": %.3f, \"steps\": %llu, \"steps_per_s\": %.1f, ")
+                _T("\"steps_per_pixel\": {\"mean\": %.3f, \"min\": %d, \"p50\": %d, \"p90\": %d, \"p99\": %d, \"max\": %d}, ")
+                _T("\"checksum\": \"%016llx\"}"),
+                i ? _T(",") : _T(""), JsonEscape(r.sFile).c_str(), JsonEscape(r.sKernel).c_str(),
+                r.sCpuLevel.c_str(), r.sCpuDetected.c_str(), r.nPixels, r.fSeconds,
+                r.nPixels / r.fSeconds, r.nSteps, r.nSteps / r.fSeconds,
+                r.fMeanSteps, r.nMinSteps, r.nMedSteps, r.nP90Steps, r.nP99Steps, r.nMaxSteps, r.nChecksum);
+    }
+
+    wprintf(_T("\n  ]\n}\n"));
+}
+
+//-------------------------------------------------------------------------------------------
+int wmain(int argc, wchar_t *argv[])
+{
+    if (!AfxWinInit(::GetModuleHandle(NULL), NULL, ::GetCommandLine(), 0))
+        return 1;
+
+    try
+    {
+        bool bJson(false);
+        int nSamples(2000);
+        unsigned nSeed(1);
+        std::vector<std::wstring> vFiles;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::wstring sArg(argv[i]), sUpper(su::to_upper(sArg));
+            if (sUpper == _T("/JSON"))
+                bJson = true;
+            else if (sUpper.compare(0, 9, _T("/SAMPLES:")) == 0)
+                nSamples = _wtoi(sArg.c_str() + 9);
+            else if (sUpper.compare(0, 6, _T("/SEED:")) == 0)
+                nSeed = (unsigned)_wtoi(sArg.c_str() + 6);
+            else if (sArg.length() && sArg[0] == _T('/'))
+                throw utils::wruntime_error(_T("usage: Bench [/json] [/samples:N] [/seed:N] [config.cfg | directory]..."));
+            else
+            {
+                DWORD dwAttr(GetFileAttributes(sArg.c_str()));
+                if (dwAttr != INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_DIRECTORY))
+                    AddDirectory(sArg, vFiles);
+                else
+                    vFiles.push_back(sArg);
+            }
+        }
+
+        if (nSamples <= 0)
+            throw utils::wruntime_error(_T("Number of samples must be greater then zero."));
+
+        // The shipped configurations are in the working directory of the program
+        if (vFiles.empty())
+            AddDirectory(_T("."), vFiles);
+
+        if (vFiles.empty())
+            throw utils::wruntime_error(_T("No configuration files found."));
+
+        std::vector<SResult> vRes;
+        for (std::size_t i = 0; i < vFiles.size(); ++i)
+        {
+            try
+            {
+                vRes.push_back(RunBenchmark(vFiles[i], nSamples, nSeed));
+            }
+            catch (utils::wruntime_error &e)
+            {
+                throw utils::wruntime_error(vFiles[i] + _T(": ") + e.message());
+            }
+        }
+
+        if (bJson)
+            PrintJson(vRes, nSamples, nSeed);
+        else
+            PrintText(vRes);
+    }
+    catch (utils::wruntime_error &e)
+    {
+        fwprintf(stderr, _T("%ls\n"), e.message().c_str());
+        return 1;
+    }
+    catch (std::exception &)
+    {
+        fwprintf(stderr, _T("unexpected exception\n"));
+        return 1;
+    }
+
+    return 0;
+}
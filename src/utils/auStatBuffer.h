@@ -105,12 +105,10 @@ StatBuffer<TData>::StatBuffer(const self_type &obj)
   ,m_sum(obj.m_sum)
   ,m_sumOfSquares(obj.m_sumOfSquares)
   ,m_variance(obj.m_variance)
-  ,m_min()
-  ,m_max()
-  ,m_MinBuf(obj.m_MinBuf)
-  ,m_MaxBuf(obj.m_MaxBuf)
-  ,m_bUpdateMax(obj.m_bUpdate)
-  ,m_bUpdateMin(obj.m_bUpdate)
+  ,m_min(obj.m_min)
+  ,m_max(obj.m_max)
+  ,m_bUpdateMax(obj.m_bUpdateMax)
+  ,m_bUpdateMin(obj.m_bUpdateMin)
 {}
 
 //---------------------------------------------------------------------------
@@ -125,7 +123,7 @@ StatBuffer<TData>::~StatBuffer()
 template<typename TData>
 void StatBuffer<TData>::Push(const TData& val)
 {
-  TData oldVal(Back());  // oldVal: Wert, der aus dem Puffer fallen wird.
+  TData oldVal(this->Back());  // oldVal: Wert, der aus dem Puffer fallen wird.
   parent_type::Push(val);
 
   // Beitrag des neuen Wertes zu den Statistikdaten
@@ -253,7 +251,7 @@ const TData& StatBuffer<TData>::Min() const
 {
   if (m_bUpdateMin)
   {
-    m_min = *std::min_element(m_Data.begin(), m_Data.end());
+    m_min = *std::min_element(this->m_Data.begin(), this->m_Data.end());
     m_bUpdateMin = false;
   }
 
@@ -266,7 +264,7 @@ const TData& StatBuffer<TData>::Max() const
 {
   if (m_bUpdateMax)
   {
-    m_max = *std::max_element(m_Data.begin(), m_Data.end());
+    m_max = *std::max_element(this->m_Data.begin(), this->m_Data.end());
     m_bUpdateMax = false;
   }
 
@@ -26,6 +26,7 @@ namespace mu
         //---------------------------------------------------------------------------------------
         BlockMatrix()
             :m_pData(nullptr)
+            , m_pMove(nullptr)
             , m_rows(0)
             , m_cols(0)
             , m_size(0)
@@ -35,6 +36,7 @@ namespace mu
         ~BlockMatrix()
         {
             delete[] m_pData;
+            delete[] m_pMove;
         }
 
         //---------------------------------------------------------------------------------------
@@ -42,11 +44,43 @@ namespace mu
         {
             delete[] m_pData;
             m_pData = new value_type[rows*cols];
-            Nullify();
 
             m_cols = cols;
             m_rows = rows;
             m_size = cols*rows;
+            Nullify();
+        }
+
+        //---------------------------------------------------------------------------------------
+        /** \brief Start moving the data to a new buffer.
+
+          The pages of the new buffer are untouched until MoveRows copies a range of rows, the
+          operating system places them on the NUMA node of the thread doing the copy.
+          */
+        void BeginMove()
+        {
+            delete[] m_pMove;
+            m_pMove = new value_type[m_size];
+        }
+
+        //---------------------------------------------------------------------------------------
+        /** \brief Copy the rows [row0, row1) to the new buffer, rows beyond the matrix are ignored. */
+        void MoveRows(std::size_t row0, std::size_t row1)
+        {
+            assert(m_pMove);
+            row1 = (row1 < m_rows) ? row1 : m_rows;
+            if (row0 < row1)
+                std::memcpy(&m_pMove[row0*m_cols], &m_pData[row0*m_cols], (row1 - row0)*m_cols*sizeof(value_type));
+        }
+
+        //---------------------------------------------------------------------------------------
+        /** \brief Replace the data by the new buffer, all rows must have been moved. */
+        void EndMove()
+        {
+            assert(m_pMove);
+            delete[] m_pData;
+            m_pData = m_pMove;
+            m_pMove = nullptr;
         }
 
         //---------------------------------------------------------------------------------------
@@ -144,6 +178,7 @@ namespace mu
 
     private:
         value_type *m_pData;
+        value_type *m_pMove;    ///< Buffer the data is moved to, only valid between BeginMove and EndMove
         std::size_t m_rows;
         std::size_t m_cols;
         std::size_t m_size;
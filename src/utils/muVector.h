@@ -5,6 +5,7 @@
 #include <memory.h>  // for memset
 #include <cstdlib>
 #include <cassert>
+#include <type_traits>
 
 //-------------------------------------------------------------------------------------------
 #include "utils/utMemory.h"
@@ -26,89 +27,69 @@ namespace mu
   //-------------------------------------------------------------------------------------------
   // Addition of two vectors
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator+( const Vector<TValType, TDim> &v1, 
+  constexpr Vector<TValType, TDim> operator+( const Vector<TValType, TDim> &v1, 
                                     const Vector<TValType, TDim> &v2 );
   //-------------------------------------------------------------------------------------------
   // Subtraction of two vectors
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator-( const Vector<TValType, TDim> &v1, 
+  constexpr Vector<TValType, TDim> operator-( const Vector<TValType, TDim> &v1, 
                                     const Vector<TValType, TDim> &v2 );
 
   //-------------------------------------------------------------------------------------------
   // Multiplication of two vectors element wise
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v1, 
+  constexpr Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v1, 
                                     const Vector<TValType, TDim> &v2 );
 
   //-------------------------------------------------------------------------------------------
   // Multiplication of two vectors element wise
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator/( const Vector<TValType, TDim> &v1, 
+  constexpr Vector<TValType, TDim> operator/( const Vector<TValType, TDim> &v1, 
                                     const Vector<TValType, TDim> &v2 );
 
   //-------------------------------------------------------------------------------------------
   // Multiplication with a value 
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator*( const TValType &val, 
+  constexpr Vector<TValType, TDim> operator*( const TValType &val, 
                                     const Vector<TValType, TDim> &v2 );
   template<typename TValType, int TDim>
-  Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v2,
+  constexpr Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v2,
                                     const TValType &val );
 
   //-------------------------------------------------------------------------------------------
-  /** \brief Fixed size vector. */
+  /** \brief Fixed size vector.
+
+    The vector is trivially copyable and has no vtable so it can be kept in registers
+    and containers of vectors can be copied with memcpy. Don't add a virtual function.
+    */
   template<typename TValType, int TDim>
   class Vector
   {
-  template <typename TValType, int TDim>  
-  friend TValType abs(const Vector& v);
-
-  template <typename TValType, int TDim>  
-  friend Vector operator+( const Vector&, const Vector& );
-
-  template <typename TValType, int TDim>  
-  friend Vector operator*( const Vector&, const Vector& );
-
-  template <typename TValType, int TDim>  
-  friend Vector operator/( const Vector&, const Vector& );
-
-  template <typename TValType, int TDim>  
-  friend Vector operator-( const Vector&, const Vector& );
-
-  template<typename TValType, int TDim>
-  friend Vector operator*( const TValType&, 
-                           const Vector& );
-
   public:	
     typedef TValType value_type;
 
     //-----------------------------------------------------------------------------------------
-    Vector()
-    {
-      utils::memzero(m_aData);
-    }
+    /** \brief Creates a vector with all elements set to zero. */
+    constexpr Vector()
+      :m_aData()
+    {}
 
     //-----------------------------------------------------------------------------------------
-    Vector(value_type v1, value_type v2)
+    constexpr Vector(value_type v1, value_type v2)
+      :m_aData{ v1, v2 }
     {
-      Assign(v1, v2);
+      static_assert(TDim==2, "Vector dimension must be 2.");
     }
 
     //-----------------------------------------------------------------------------------------
-    Vector(value_type v1, value_type v2, value_type v3)
+    constexpr Vector(value_type v1, value_type v2, value_type v3)
+      :m_aData{ v1, v2, v3 }
     {
-      assert(TDim==3);
-      m_aData[0] = v1;
-      m_aData[1] = v2;
-      m_aData[2] = v3;
+      static_assert(TDim==3, "Vector dimension must be 3.");
     }
 
     //-----------------------------------------------------------------------------------------
-    virtual ~Vector()
-    {}
-
-    //-----------------------------------------------------------------------------------------
-    void Assign(value_type v1, value_type v2)
+    constexpr void Assign(value_type v1, value_type v2)
     {
       assert(TDim==2);
       m_aData[0] = v1;
@@ -117,7 +98,7 @@ namespace mu
 
     //-----------------------------------------------------------------------------------------
     /** \brief Assign a value to all elements of the vector. */
-    Vector& operator=(const value_type &val)
+    constexpr Vector& operator=(const value_type &val)
     {
       for (int i=0; i<TDim; ++i)
         m_aData[i] = val;
@@ -126,7 +107,7 @@ namespace mu
     }
 
     //-----------------------------------------------------------------------------------------
-		Vector& operator+=(const Vector &v)
+		constexpr Vector& operator+=(const Vector &v)
     {
       for (int i=0; i<TDim; ++i)
         m_aData[i] += v.m_aData[i];
@@ -135,7 +116,7 @@ namespace mu
     }
 
     //-----------------------------------------------------------------------------------------
-		Vector& operator-=(const Vector &v)
+		constexpr Vector& operator-=(const Vector &v)
     {
       for (int i=0; i<TDim; ++i)
         m_aData[i] -= v.m_aData[i];
@@ -144,7 +125,7 @@ namespace mu
     }
 
     //-----------------------------------------------------------------------------------------
-	  Vector& operator*=(const double &v)
+	  constexpr Vector& operator*=(const double &v)
     {
       for (int i=0; i<TDim; ++i)
         m_aData[i] *= v;
@@ -153,7 +134,7 @@ namespace mu
     }
 
     //-----------------------------------------------------------------------------------------
-	  Vector& operator/=(const double &v)
+	  constexpr Vector& operator/=(const double &v)
     {
       for (int i=0; i<TDim; ++i)
         m_aData[i] /= v;
@@ -162,14 +143,13 @@ namespace mu
     }
 
     //-----------------------------------------------------------------------------------------
-    const value_type& operator[](std::size_t i) const
+    constexpr const value_type& operator[](std::size_t i) const
     {
-      assert(i<TDim);
-      return m_aData[i];
+      return assert(i<TDim), m_aData[i];
     }
 
     //-----------------------------------------------------------------------------------------
-	  value_type& operator[](std::size_t i)
+	  constexpr value_type& operator[](std::size_t i)
     {
       assert(i<TDim);
       return m_aData[i];
@@ -187,6 +167,13 @@ namespace mu
   /** \brief Type for a two dimensional vector. */
   typedef Vector<double, 2> vec2d_type;
 
+  //-------------------------------------------------------------------------------------------
+  /** \brief Type for a two dimensional vector of single precision numbers. */
+  typedef Vector<float, 2> vec2f_type;
+
+  static_assert(std::is_trivially_copyable<vec2d_type>::value, "vec2d_type must be trivially copyable.");
+  static_assert(sizeof(vec2d_type) == 2 * sizeof(double), "vec2d_type must not carry any overhead.");
+
   //-------------------------------------------------------------------------------------------
   /** \brief Type for a two dimensional vector of integer numbers. */
   typedef Vector<int, 2> ivec2d_type;
@@ -205,48 +192,48 @@ namespace mu
 
   //-------------------------------------------------------------------------------------------
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator+( const Vector<TValType, TDim> &v1, 
+  inline constexpr Vector<TValType, TDim> operator+( const Vector<TValType, TDim> &v1, 
                                            const Vector<TValType, TDim> &v2 )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = v1.m_aData[i] + v2.m_aData[i];
+      res[i] = v1[i] + v2[i];
 
     return res;
   }
 
   //-------------------------------------------------------------------------------------------
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator-( const Vector<TValType, TDim> &v1, 
+  inline constexpr Vector<TValType, TDim> operator-( const Vector<TValType, TDim> &v1, 
                                            const Vector<TValType, TDim> &v2 )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = v1.m_aData[i] - v2.m_aData[i];
+      res[i] = v1[i] - v2[i];
 
     return res;
   }
 
   //-------------------------------------------------------------------------------------------
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v1, 
+  inline constexpr Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v1, 
                                            const Vector<TValType, TDim> &v2 )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = v1.m_aData[i] * v2.m_aData[i];
+      res[i] = v1[i] * v2[i];
 
     return res;
   }
 
   //-------------------------------------------------------------------------------------------
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator/( const Vector<TValType, TDim> &v1, 
+  inline constexpr Vector<TValType, TDim> operator/( const Vector<TValType, TDim> &v1, 
                                            const Vector<TValType, TDim> &v2 )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = v1.m_aData[i] / v2.m_aData[i];
+      res[i] = v1[i] / v2[i];
 
     return res;
   }
@@ -254,12 +241,12 @@ namespace mu
   //-------------------------------------------------------------------------------------------
   /** \brief Multiply every entry in a vector with a value. */
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator*( const TValType &val, 
+  inline constexpr Vector<TValType, TDim> operator*( const TValType &val, 
                                            const Vector<TValType, TDim> &v2 )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = val * v2.m_aData[i];
+      res[i] = val * v2[i];
 
     return res;
   }
@@ -267,12 +254,12 @@ namespace mu
   //-------------------------------------------------------------------------------------------
   /** \brief Multiply every entry in a vector with a value. */
   template<typename TValType, int TDim>
-  inline Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v2,
+  inline constexpr Vector<TValType, TDim> operator*( const Vector<TValType, TDim> &v2,
                                            const TValType &val )
   {
     Vector<TValType, TDim> res;
     for (int i=0; i<TDim; ++i)
-      res.m_aData[i] = val * v2.m_aData[i];
+      res[i] = val * v2[i];
 
     return res;
   }